@@ -5,19 +5,48 @@ in vec2 fragTexCoord;
 in vec4 fragColor;
 
 // Input uniform values
-uniform sampler2D texture0;
+uniform sampler2D texture0; // one material ID per texel, stored in the red channel
 uniform vec4 colDiffuse;
 
+// Material palette, one texel per PixelType
+uniform sampler2D palette;
+uniform float paletteSize;
+
+// Animation and cell lookup, time in seconds wraps every minute or so to keep its precision
+uniform float time;
+uniform vec2 worldSize;
+
 // Output fragment color
 out vec4 finalColor;
 
 // Simple color adjustments
 uniform float brightness = 1.0;
 
+const float FIRE = 4.0;
+
+// Cheap per-cell hash in [0, 1)
+float hash(vec2 p)
+{
+    p = fract(p * vec2(0.1031, 0.1030));
+    p += dot(p, p.yx + 33.33);
+    return fract((p.x + p.y) * p.x);
+}
+
 void main() {
-    // Sample the texture with nearest neighbor filtering
-    vec4 texelColor = texture(texture0, fragTexCoord) * colDiffuse;
-    
+    // Decode the material ID with nearest neighbor sampling
+    float id = floor(texture(texture0, fragTexCoord).r * 255.0 + 0.5);
+    vec4 texelColor = texture(palette, vec2((id + 0.5) / paletteSize, 0.5));
+
+    // Fire flickers to a new colour every frame at 60 Hz, independently per cell
+    if (id == FIRE)
+    {
+        vec2 cell = floor(fragTexCoord * worldSize) + floor(time * 60.0) * vec2(17.0, 59.0);
+        texelColor.rgb = vec3(mix(100.0, 200.0, hash(cell)),
+                              mix(40.0, 80.0, hash(cell + 101.0)),
+                              mix(10.0, 20.0, hash(cell + 211.0))) / 255.0;
+    }
+    texelColor *= colDiffuse;
+
     // Apply brightness
     vec3 color = texelColor.rgb * brightness;
     
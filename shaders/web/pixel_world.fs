@@ -1,17 +1,49 @@
 #version 100
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+precision highp float;
+#else
 precision mediump float;
+#endif
 
 // Input varyings from vertex shader
 varying vec2 fragTexCoord;
 varying vec4 fragColor;
 
 // Uniforms
-uniform sampler2D texture0;
+uniform sampler2D texture0; // one material ID per texel, stored in the red channel
 uniform vec4 colDiffuse;
 
+// Material palette, one texel per PixelType (GLSL ES 1.0 cannot index uniform arrays dynamically)
+uniform sampler2D palette;
+uniform float paletteSize;
+
+// Animation and cell lookup, time in seconds wraps every minute or so to keep its precision
+uniform float time;
+uniform vec2 worldSize;
+
+const float FIRE = 4.0;
+
+// Cheap per-cell hash in [0, 1)
+float hash(vec2 p)
+{
+    p = fract(p * vec2(0.1031, 0.1030));
+    p += dot(p, p.yx + 33.33);
+    return fract((p.x + p.y) * p.x);
+}
+
 void main() {
-    // Sample the texture
-    vec4 texelColor = texture2D(texture0, fragTexCoord);
+    // Decode the material ID
+    float id = floor(texture2D(texture0, fragTexCoord).r * 255.0 + 0.5);
+    vec4 texelColor = texture2D(palette, vec2((id + 0.5) / paletteSize, 0.5));
+
+    // Fire flickers to a new colour every frame at 60 Hz, independently per cell
+    if (id == FIRE)
+    {
+        vec2 cell = floor(fragTexCoord * worldSize) + floor(time * 60.0) * vec2(17.0, 59.0);
+        texelColor.rgb = vec3(mix(100.0, 200.0, hash(cell)),
+                              mix(40.0, 80.0, hash(cell + 101.0)),
+                              mix(10.0, 20.0, hash(cell + 211.0))) / 255.0;
+    }
     
     // Apply color tint and alpha
     vec4 finalColor = texelColor * colDiffuse * fragColor;
@@ -1,16 +1,93 @@
 #include "Application.hpp"
 #include <raylib.h>
 #include <algorithm>
+#include <climits>
 #include <math.h>
+#include <thread>
+
+static const char *AUTOSAVE_PATH = "autosave.pxw";
+static const char *QUICKSAVE_PATH = "quicksave.pxw";
+static const double AUTOSAVE_INTERVAL = 30.0; // seconds
+static const int REWIND_STEP = 2;            // recorded ticks per frame while Z or X is held
+static const float UPDATE_BUDGET_MS = 4.0f;  // movement passes per tick, far chunks wait past it
+
+// Brush: a round stroke from last frame's cursor, painting a share of the cells it covers
+static const int BRUSH_RADIUS = 10;
+static const uint8_t BRUSH_DENSITY = 16;       // left click, out of EDIT_SOLID
+static const uint8_t BRUSH_DENSITY_HEAVY = 64; // right click
+static const int BLAST_RADIUS = 16;
+
+// Desktop builds can stream the world instead (--stream): the grid becomes a window onto a
+// map far larger than the screen, paged to chunk files in STREAM_DIRECTORY. Memory stays
+// bounded by the resident chunk limit.
+#if !(defined(PLATFORM_WEB) || defined(__EMSCRIPTEN__))
+static const bool STREAM_AVAILABLE = true;
+#else
+static const bool STREAM_AVAILABLE = false;
+#endif
+static const char *STREAM_DIRECTORY = "world";
+static const int STREAM_WORLD_WIDTH = 32768;
+static const int STREAM_WORLD_HEIGHT = 4096;
+static const int STREAM_RESIDENT_CHUNKS = 2048; // 24 MB of chunks besides the window
+static const int CAMERA_SPEED = 8;              // cells per frame, four times that with shift
+
+// The simulation spreads over a worker pool wherever there are threads. Threaded web builds
+// stay within the web workers spawned at startup, see SANDBOX_WEB_THREADS in CMakeLists.txt.
+#if defined(__EMSCRIPTEN_PTHREADS__)
+#define SIMULATION_WORKERS
+static const int MAX_SIMULATION_THREADS = SANDBOX_WEB_WORKERS;
+#elif !defined(__EMSCRIPTEN__)
+#define SIMULATION_WORKERS
+static const int MAX_SIMULATION_THREADS = INT_MAX;
+#endif
+
+// Rolling stone hills along the bottom of the streamed world
+static void generateTerrain(int cx, int cy, ChunkCells &cells)
+{
+    const int C = PixelWorld::CHUNK_SIZE;
+    cells.clear();
+    for (int x = 0; x < C; x++)
+    {
+        double wx = cx * C + x;
+        int surface = STREAM_WORLD_HEIGHT - 192 + static_cast<int>(96 * sin(wx / 700.0) + 32 * sin(wx / 97.0));
+        for (int y = std::max(surface - cy * C, 0); y < C; y++)
+            cells.types[y * C + x] = PixelType::STONE;
+    }
+}
+
+// Serial, checkerboard where there are workers, then bitplane and margolus
+static UpdateMode nextUpdateMode(UpdateMode mode)
+{
+    switch (mode)
+    {
+    case UpdateMode::SERIAL:
+#ifdef SIMULATION_WORKERS
+        return UpdateMode::CHECKERBOARD;
+#else
+        return UpdateMode::BITPLANE;
+#endif
+    case UpdateMode::CHECKERBOARD: return UpdateMode::BITPLANE;
+    case UpdateMode::BITPLANE: return UpdateMode::MARGOLUS;
+    case UpdateMode::MARGOLUS: return UpdateMode::SERIAL;
+    }
+    return UpdateMode::SERIAL;
+}
 
-Application::Application(int width, int height, const char *title)
+static int simulationCells(int viewCells, bool stream)
+{
+    return stream ? Simulation::streamWindowCells(viewCells) : viewCells;
+}
+
+Application::Application(int width, int height, const char *title, bool stream)
     : m_width(width), m_height(height), m_title(title),
-      m_world(width / 2, height / 2),
+      m_sim(simulationCells(width / 2, stream && STREAM_AVAILABLE), simulationCells(height / 2, stream && STREAM_AVAILABLE)),
       m_renderer(2)
 {
     SetConfigFlags(FLAG_WINDOW_HIGHDPI);
     InitWindow(m_width, m_height, m_title);
 
+    PROFILE_THREAD("render");
+
     // Initialize raygui
     GuiLoadStyleDefault();
 
@@ -20,9 +97,68 @@ Application::Application(int width, int height, const char *title)
 
     SetTargetFPS(120);
     m_scale = 2;
+
+    // Needs the GL context, so it can't happen in the member initializer
+    m_renderer.load();
+
+    // Pick up where the last session stopped, streamed worlds keep themselves in their chunk files
+    if (stream && STREAM_AVAILABLE)
+    {
+        StreamSettings stream;
+        stream.worldWidth = STREAM_WORLD_WIDTH;
+        stream.worldHeight = STREAM_WORLD_HEIGHT;
+        stream.directory = STREAM_DIRECTORY;
+        stream.residentChunks = STREAM_RESIDENT_CHUNKS;
+        stream.generate = generateTerrain;
+        m_sim.enableStreaming(std::move(stream));
+
+        m_cameraX = (STREAM_WORLD_WIDTH - m_width / m_scale) / 2;
+        m_cameraY = STREAM_WORLD_HEIGHT - m_height / m_scale;
+        m_sim.setCamera(m_cameraX, m_cameraY);
+    }
+    else
+    {
+        WorldFrame saved;
+        if (loadSnapshot(AUTOSAVE_PATH, saved))
+            m_sim.submit([saved](PixelWorld &world) { world.loadFrame(saved); });
+    }
+    m_lastAutosave = GetTime();
+
+#ifdef SIMULATION_WORKERS
+    // Spread the simulation over every core
+    int threads = std::min(static_cast<int>(std::thread::hardware_concurrency()), MAX_SIMULATION_THREADS);
+    m_sim.submit([threads](PixelWorld &world)
+                 {
+                     world.setThreadCount(threads);
+                     world.setUpdateMode(UpdateMode::CHECKERBOARD);
+                 });
+#endif
+
+    // Busy scenes run far chunks less often rather than slowing every tick down, and pools
+    // level out in bulk rather than a cell at a time
+    m_sim.submit([](PixelWorld &world)
+                 {
+                     world.setUpdateBudget(UPDATE_BUDGET_MS);
+                     world.setLiquidLevelling(true);
+                 });
+
+    m_sim.start();
 }
 
-Application::~Application() { CloseWindow(); }
+Application::~Application()
+{
+    // Save the live world rather than the last frame drawn, which may be a rewound tick.
+    // Stopping writes streamed worlds out.
+    m_sim.stop();
+    if (!m_sim.streaming())
+    {
+        WorldFrame frame;
+        m_sim.copyWorld(frame);
+        m_snapshotWriter.submit(AUTOSAVE_PATH, std::move(frame)); // written before m_snapshotWriter is destroyed
+    }
+    m_renderer.unload();
+    CloseWindow();
+}
 
 // Forward declaration for Emscripten callback
 #ifdef __EMSCRIPTEN__
@@ -44,6 +180,7 @@ void Application::frame()
 #endif
         return;
     }
+    PROFILE_SCOPE("frame");
 
     // Update window dimensions if resized
     int newWidth = GetScreenWidth();
@@ -56,35 +193,151 @@ void Application::frame()
     }
 
     // Process input
-    processInput();
+    {
+        PROFILE_SCOPE("frame.input");
+        processInput();
+        moveCamera();
+
+        // M cycles the update mode, [ and ] change the thread count where there are workers
+        if (IsKeyPressed(KEY_M))
+            m_sim.submit([](PixelWorld &world) { world.setUpdateMode(nextUpdateMode(world.updateMode())); });
+#ifdef SIMULATION_WORKERS
+        if (IsKeyPressed(KEY_LEFT_BRACKET))
+            m_sim.submit([](PixelWorld &world) { world.setThreadCount(world.threadCount() - 1); });
+        if (IsKeyPressed(KEY_RIGHT_BRACKET))
+            m_sim.submit([](PixelWorld &world) { world.setThreadCount(std::min(world.threadCount() + 1, MAX_SIMULATION_THREADS)); });
+#endif
+
+        // The budget favours the chunks around the cursor, B turns it off and on
+        Vector2 focus = getWorldMousePosition();
+        m_sim.setFocus(static_cast<int>(focus.x), static_cast<int>(focus.y));
+        if (IsKeyPressed(KEY_B))
+            m_sim.submit([](PixelWorld &world)
+                         { world.setUpdateBudget(world.updateBudget() > 0.0f ? 0.0f : UPDATE_BUDGET_MS); });
+
+        // Z rewinds while held and X steps forward again, back to the live world past the newest
+        // tick. R carries on from the tick shown instead. The world on screen is a recording
+        // until then and the live world it replaces is out of sight, so nothing edits either.
+        if (IsKeyDown(KEY_Z))
+            m_sim.rewind(-REWIND_STEP);
+        else if (IsKeyDown(KEY_X) && m_sim.frame().rewinding)
+            m_sim.rewind(REWIND_STEP);
+        if (IsKeyPressed(KEY_R))
+            m_sim.resume();
+
+        if (!m_sim.rewinding())
+        {
+            paint();
+
+            // E blasts the cells around the cursor out as particles
+            if (IsKeyPressed(KEY_E))
+            {
+                Vector2 mouse = getWorldMousePosition();
+                EditBuffer edits;
+                edits.explode(static_cast<int>(mouse.x), static_cast<int>(mouse.y), BLAST_RADIUS);
+                m_sim.queueEdits(edits);
+            }
+        }
+
+        // Dropping an image file on the window stamps it into the world at the cursor
+        if (IsFileDropped())
+        {
+            FilePathList files = LoadDroppedFiles();
+            for (unsigned int i = 0; i < files.count && !m_sim.rewinding(); i++)
+                stampImage(files.paths[i], getWorldMousePosition());
+            UnloadDroppedFiles(files);
+        }
+
+        // F cycles fast-forward through 1x, 2x, 4x and 8x
+        if (IsKeyPressed(KEY_F))
+            m_sim.setSpeed(m_sim.speed() >= Simulation::MAX_SPEED ? 1 : m_sim.speed() * 2);
+
+        // Snapshots: F5 quick saves, F9 loads the quick save, autosave runs periodically.
+        // Saves only copy the frame here, encoding and disk I/O happen on the writer thread.
+        // A snapshot holds the grid alone, which for a streamed world is just the window, so
+        // those keep to their chunk files instead. The frame shown during a rewind is a
+        // recorded tick, so nothing is saved from it.
+        bool live = !m_sim.rewinding() && !m_sim.frame().rewinding;
+        if (IsKeyPressed(KEY_F5) && !m_sim.streaming() && live)
+            saveWorld(QUICKSAVE_PATH);
+        if (IsKeyPressed(KEY_F9) && !m_sim.streaming() && !m_sim.rewinding())
+        {
+            WorldFrame saved;
+            if (loadSnapshot(QUICKSAVE_PATH, saved))
+                m_sim.submit([saved](PixelWorld &world) { world.loadFrame(saved); });
+        }
+        if (GetTime() - m_lastAutosave >= AUTOSAVE_INTERVAL && live)
+        {
+            if (m_sim.streaming())
+                m_sim.checkpoint();
+            else
+                saveWorld(AUTOSAVE_PATH);
+            m_lastAutosave = GetTime();
+        }
+    }
 
-    // Update world state
-    m_world.update(GetFrameTime());
+    // Ticks run on the simulation thread, this only does work without one
+    m_sim.pump();
 
     // Render frame
     BeginDrawing();
     ClearBackground(DARKGRAY);
 
-    // Draw the world
-    m_renderer.draw(m_world);
+    // Draw the newest finished tick, uploading only what changed since the last one drawn
+    static const std::vector<DirtyRect> unchanged;
+    bool fresh = m_sim.acquireFrame();
+    const SimFrame &sim = m_sim.frame();
+    Vector2 offset = {static_cast<float>(sim.originX - m_cameraX), static_cast<float>(sim.originY - m_cameraY)};
+    m_renderer.draw(sim.world.view(), fresh ? sim.changed : unchanged, offset);
+    m_renderer.drawParticles(sim.particles, offset);
 
     // Draw GUI
-    if (!m_guiLock)
     {
-        GuiLock();
-        processInput(); // This will draw the GUI
-        GuiUnlock();
+        PROFILE_SCOPE("frame.gui");
+        if (!m_guiLock)
+        {
+            GuiLock();
+            processInput(); // This will draw the GUI
+            GuiUnlock();
+        }
+        else
+        {
+            // If GUI is locked, still process input but don't draw
+            processInput();
+        }
+
+        // Draw FPS on top of everything
+        DrawFPS(m_width - 85, 10);
+        DrawText(TextFormat("Chunks: %d/%d", sim.activeChunks, sim.chunkCount),
+                 m_width - 140, 35, 16, WHITE);
+        DrawText(TextFormat("Sim: %.2f ms (%s, %d threads)", sim.updateMs,
+                            updateModeName(sim.mode), sim.threads),
+                 m_width - 300, 55, 16, WHITE);
+        if (m_sim.streaming())
+            DrawText(TextFormat("World %d,%d: %d chunks resident, %d saved", m_cameraX, m_cameraY,
+                                sim.residentChunks, sim.savedChunks),
+                     m_width - 380, 95, 16, WHITE);
+        if (sim.rewinding)
+            DrawText(TextFormat("Rewind: tick %llu of %llu-%llu, live world running. R resumes here, X returns",
+                                static_cast<unsigned long long>(sim.tick),
+                                static_cast<unsigned long long>(sim.historyFirst),
+                                static_cast<unsigned long long>(sim.historyLast)),
+                     m_width - 640, 75, 16, GOLD);
+        else if (m_sim.speed() > 1)
+            DrawText(TextFormat("Fast-forward x%d", m_sim.speed()), m_width - 300, 75, 16, GOLD);
+        if (sim.deferredChunks > 0)
+            DrawText(TextFormat("Behind: %d chunks held back, up to %d ticks", sim.deferredChunks, sim.maxDeferred),
+                     m_width - 380, 115, 16, ORANGE);
+
+        // Profiler overlay below the material buttons, F2 shows it and F3 captures a trace
+        m_profileOverlay.handleInput();
+        m_profileOverlay.draw(10, 260);
     }
-    else
+
     {
-        // If GUI is locked, still process input but don't draw
-        processInput();
+        PROFILE_SCOPE("frame.present");
+        EndDrawing();
     }
-
-    // Draw FPS on top of everything
-    DrawFPS(m_width - 85, 10);
-
-    EndDrawing();
 }
 
 void Application::run()
@@ -101,6 +354,34 @@ void Application::run()
 #endif
 }
 
+void Application::saveWorld(const char *path)
+{
+    WorldFrame frame = m_sim.frame().world;
+    m_snapshotWriter.submit(path, std::move(frame));
+}
+
+void Application::moveCamera()
+{
+    if (!m_sim.streaming())
+        return;
+
+    // Arrow keys pan over the streamed world, the window follows on the simulation thread
+    int speed = IsKeyDown(KEY_LEFT_SHIFT) ? CAMERA_SPEED * 4 : CAMERA_SPEED;
+    int dx = (IsKeyDown(KEY_RIGHT) ? speed : 0) - (IsKeyDown(KEY_LEFT) ? speed : 0);
+    int dy = (IsKeyDown(KEY_DOWN) ? speed : 0) - (IsKeyDown(KEY_UP) ? speed : 0);
+    if (dx == 0 && dy == 0)
+        return;
+    m_cameraX = std::clamp(m_cameraX + dx, 0, std::max(STREAM_WORLD_WIDTH - m_width / m_scale, 0));
+    m_cameraY = std::clamp(m_cameraY + dy, 0, std::max(STREAM_WORLD_HEIGHT - m_height / m_scale, 0));
+    m_sim.setCamera(m_cameraX, m_cameraY);
+}
+
+Vector2 Application::getWorldMousePosition()
+{
+    Vector2 mouse = getScaledMousePosition();
+    return {mouse.x + m_cameraX, mouse.y + m_cameraY};
+}
+
 Vector2 Application::getScaledMousePosition()
 {
     static Vector2 mouse;
@@ -127,8 +408,8 @@ Vector2 Application::getScaledMousePosition()
     mouse.y *= invScale;
 #else
     // For WebAssembly, map to world coordinates
-    float sx = static_cast<float>(m_world.width()) / static_cast<float>(currentWidth);
-    float sy = static_cast<float>(m_world.height()) / static_cast<float>(currentHeight);
+    float sx = static_cast<float>(m_sim.width()) / static_cast<float>(currentWidth);
+    float sy = static_cast<float>(m_sim.height()) / static_cast<float>(currentHeight);
     mouse.x *= sx;
     mouse.y *= sy;
 #endif
@@ -197,39 +478,9 @@ void Application::processInput()
     // Allow particle creation if not over GUI elements or if we're already drawing
     bool canCreateParticles = !mouseOverGUI || (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && !m_guiLock);
 
-    // Handle mouse input for drawing particles
-    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && canCreateParticles)
-    {
-        Vector2 mouse = getScaledMousePosition();
-        int centerX = mouse.x;
-        int centerY = mouse.y;
-
-        // Create a more natural distribution of particles
-        int radius = 10;
-        int radiusSq = radius * radius;
-        int numParticles = IsMouseButtonDown(MOUSE_BUTTON_LEFT) ? 5 : 20; // More particles for right click
-
-        for (int i = 0; i < numParticles; i++)
-        {
-            // Create a more natural distribution using polar coordinates
-            float angle = GetRandomValue(0, 628) / 100.0f; // 0-2π in radians * 100
-            float dist = GetRandomValue(0, radius * 100) / 100.0f;
-
-            // Convert to cartesian coordinates
-            int x = centerX + (int)(cosf(angle) * dist);
-            int y = centerY + (int)(sinf(angle) * dist);
-
-            // Add some randomness to the position for a more natural look
-            x += GetRandomValue(-1, 1);
-            y += GetRandomValue(-1, 1);
-
-            // Only add if within world bounds
-            if (x >= 0 && x < m_world.width() && y >= 0 && y < m_world.height())
-            {
-                m_world.addPixel(x, y, m_currentType);
-            }
-        }
-    }
+    // The brush paints once per frame in paint(), however often this runs
+    m_brushDown = (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && canCreateParticles) ||
+                  (!m_guiLock && (IsMouseButtonDown(MOUSE_BUTTON_LEFT) || IsMouseButtonDown(MOUSE_BUTTON_RIGHT)));
 
     // Set scissor mode just for GUI elements
     // Note: raylib's scissor mode is global, so we'll just set it for GUI
@@ -291,9 +542,9 @@ void Application::processInput()
     GuiSetStyle(BUTTON, BASE_COLOR_NORMAL, ColorToInt(Fade(RED, 0.6f)));
     GuiSetStyle(BUTTON, BORDER_COLOR_FOCUSED, ColorToInt(RED));
     GuiSetStyle(BUTTON, BASE_COLOR_FOCUSED, ColorToInt(Fade(RED, 0.3f)));
-    if (GuiButton(clearBtn, "Clear All"))
+    if (GuiButton(clearBtn, "Clear All") && !m_sim.rewinding())
     {
-        m_world.clear();
+        m_sim.submit([](PixelWorld &world) { world.clear(); });
     }
 
     // Disable scissor mode after GUI drawing
@@ -324,40 +575,71 @@ void Application::processInput()
     }
     DrawText(currentTypeText, 10, 10, 20, WHITE);
 
-    // Only process particle creation if not interacting with GUI
-    if (!m_guiLock && (IsMouseButtonDown(MOUSE_BUTTON_LEFT) || IsMouseButtonDown(MOUSE_BUTTON_RIGHT)))
+    // Clear with C key (kept for convenience)
+    if (IsKeyPressed(KEY_C) && !m_sim.rewinding())
+        m_sim.submit([](PixelWorld &world) { world.clear(); });
+}
+
+void Application::paint()
+{
+    if (!m_brushDown)
     {
-        Vector2 mouse = getScaledMousePosition();
-        int centerX = mouse.x;
-        int centerY = mouse.y;
+        m_brushHeld = false;
+        return;
+    }
 
-        // Create a more natural distribution of particles
-        int radius = 10;
-        int radiusSq = radius * radius;
-        int numParticles = IsMouseButtonDown(MOUSE_BUTTON_LEFT) ? 5 : 20; // More particles for right click
+    // Stroke from where the brush was last frame so fast drags leave no gaps
+    Vector2 mouse = getWorldMousePosition();
+    Vector2 from = m_brushHeld ? m_lastBrush : mouse;
+    uint8_t density = IsMouseButtonDown(MOUSE_BUTTON_LEFT) ? BRUSH_DENSITY : BRUSH_DENSITY_HEAVY;
 
-        for (int i = 0; i < numParticles; i++)
-        {
-            // Create a more natural distribution using polar coordinates
-            float angle = GetRandomValue(0, 628) / 100.0f; // 0-2π in radians * 100
-            float dist = GetRandomValue(0, radius * 100) / 100.0f;
+    EditBuffer edits;
+    edits.strokeLine(static_cast<int>(from.x), static_cast<int>(from.y), static_cast<int>(mouse.x),
+                     static_cast<int>(mouse.y), BRUSH_RADIUS, m_currentType, density);
+    m_sim.queueEdits(edits);
+
+    m_lastBrush = mouse;
+    m_brushHeld = true;
+}
 
-            // Convert to cartesian coordinates
-            int x = centerX + (int)(cosf(angle) * dist);
-            int y = centerY + (int)(sinf(angle) * dist);
+void Application::stampImage(const char *path, Vector2 center)
+{
+    Image image = LoadImage(path);
+    if (!IsImageValid(image))
+    {
+        TraceLog(LOG_WARNING, "STAMP: cannot load %s", path);
+        return;
+    }
 
-            // Add some randomness to the position for a more natural look
-            x += GetRandomValue(-1, 1);
-            y += GetRandomValue(-1, 1);
+    // Transparent pixels keep the world, everything else becomes the material of the nearest colour
+    Color *colors = LoadImageColors(image);
+    std::vector<uint8_t> mask(image.width * image.height);
+    for (size_t i = 0; i < mask.size(); i++)
+    {
+        Color c = colors[i];
+        mask[i] = MASK_KEEP;
+        if (c.a < 128)
+            continue;
 
-            // Only add if within world bounds
-            if (x >= 0 && x < m_world.width() && y >= 0 && y < m_world.height())
+        int best = INT_MAX;
+        for (int m = 1; m < MATERIAL_COUNT; m++)
+        {
+            const uint8_t *rgb = MATERIALS[m].color;
+            int dr = c.r - rgb[0], dg = c.g - rgb[1], db = c.b - rgb[2];
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < best)
             {
-                m_world.addPixel(x, y, m_currentType);
+                best = distance;
+                mask[i] = static_cast<uint8_t>(m);
             }
         }
     }
-    // Clear with C key (kept for convenience)
-    if (IsKeyPressed(KEY_C))
-        m_world.clear();
+
+    EditBuffer edits;
+    edits.stampMask(static_cast<int>(center.x) - image.width / 2, static_cast<int>(center.y) - image.height / 2,
+                    image.width, image.height, mask.data());
+    m_sim.queueEdits(edits);
+
+    UnloadImageColors(colors);
+    UnloadImage(image);
 }
@@ -1,20 +1,28 @@
 #pragma once
-#include "PixelWorld.hpp"
+#include "ProfileOverlay.hpp"
 #include "Renderer.hpp"
+#include "Simulation.hpp"
+#include "Snapshot.hpp"
 #include <raylib.h>
 #include <raygui.h>
 
 class Application
 {
 public:
-    Application(int width, int height, const char *title);
+    // stream makes the world a window onto a large map paged to disk, desktop builds only
+    Application(int width, int height, const char *title, bool stream = false);
     ~Application();
     void run();
     void frame();
 
 private:
     Vector2 getScaledMousePosition();
+    Vector2 getWorldMousePosition(); // edits take world cells
     void processInput();
+    void moveCamera();
+    void paint();
+    void stampImage(const char *path, Vector2 center);
+    void saveWorld(const char *path);
 
     int m_width, m_height;
     int m_scale;
@@ -22,7 +30,15 @@ private:
     bool m_running = true;
 
     PixelType m_currentType = PixelType::SAND;
-    PixelWorld m_world;
+    Simulation m_sim;
+    int m_cameraX = 0, m_cameraY = 0; // world cell at the screen's top left
     Renderer m_renderer;
+    ProfileOverlay m_profileOverlay;
     bool m_guiLock = false; // Controls whether GUI is locked (not visible)
+    bool m_brushDown = false; // set by processInput, painted by paint()
+    bool m_brushHeld = false; // painted last frame too, m_lastBrush is valid
+    Vector2 m_lastBrush = {0, 0};
+
+    SnapshotWriter m_snapshotWriter;
+    double m_lastAutosave = 0.0;
 };
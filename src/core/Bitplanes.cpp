@@ -0,0 +1,421 @@
+#include "Bitplanes.hpp"
+#include <algorithm>
+#include <bit>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+static constexpr int EMPTY = static_cast<int>(PixelType::EMPTY);
+
+// Falling materials, densest first, so sand sinks through the liquids before they move
+struct FallOrder
+{
+    int types[MATERIAL_COUNT];
+    int count;
+};
+
+constexpr FallOrder makeFallOrder()
+{
+    FallOrder order{};
+    for (int type = 0; type < MATERIAL_COUNT; type++)
+    {
+        if (!isFalling(static_cast<PixelType>(type)))
+            continue;
+        int i = order.count++;
+        for (; i > 0 && MATERIALS[order.types[i - 1]].density < MATERIALS[type].density; i--)
+            order.types[i] = order.types[i - 1];
+        order.types[i] = type;
+    }
+    return order;
+}
+
+static constexpr FallOrder FALL_ORDER = makeFallOrder();
+
+// Sets bit i of out[type * stride] for each types[i], count <= 64
+static void packWord(const PixelType *types, int count, uint64_t *out, int stride)
+{
+    const uint8_t *t = reinterpret_cast<const uint8_t *>(types);
+    uint64_t bits[MATERIAL_COUNT] = {};
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(t + i));
+        for (int type = 0; type < MATERIAL_COUNT; type++)
+        {
+            __m256i hit = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(type)));
+            bits[type] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hit))) << i;
+        }
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + i));
+        for (int type = 0; type < MATERIAL_COUNT; type++)
+        {
+            __m128i hit = _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(type)));
+            bits[type] |= static_cast<uint64_t>(_mm_movemask_epi8(hit) & 0xFFFF) << i;
+        }
+    }
+#elif defined(__wasm_simd128__)
+    for (; i + 16 <= count; i += 16)
+    {
+        v128_t v = wasm_v128_load(t + i);
+        for (int type = 0; type < MATERIAL_COUNT; type++)
+        {
+            v128_t hit = wasm_i8x16_eq(v, wasm_i8x16_splat(static_cast<int8_t>(type)));
+            bits[type] |= static_cast<uint64_t>(wasm_i8x16_bitmask(hit)) << i;
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+        bits[t[i]] |= 1ull << i;
+    for (int type = 0; type < MATERIAL_COUNT; type++)
+        out[type * stride] = bits[type];
+}
+
+// Writes all 64 cells of a word from its planes, exactly one of which holds each cell
+static void unpackWord(const uint64_t *planes, int stride, PixelType *types)
+{
+    uint8_t *t = reinterpret_cast<uint8_t *>(types);
+    int i = 0;
+
+#if defined(__AVX2__)
+    // Byte k of the broadcast word goes to cells 8k..8k+7, then each keeps its own bit
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i select = _mm256_set1_epi64x(static_cast<long long>(0x8040201008040201ull));
+    for (; i < 64; i += 32)
+    {
+        __m256i cells = _mm256_setzero_si256();
+        for (int type = 1; type < MATERIAL_COUNT; type++)
+        {
+            __m256i bits = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(planes[type * stride] >> i)), spread);
+            __m256i hit = _mm256_cmpeq_epi8(_mm256_and_si256(bits, select), select);
+            cells = _mm256_or_si256(cells, _mm256_and_si256(hit, _mm256_set1_epi8(static_cast<char>(type))));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(t + i), cells);
+    }
+#elif defined(__SSSE3__)
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i select = _mm_set1_epi64x(static_cast<long long>(0x8040201008040201ull));
+    for (; i < 64; i += 16)
+    {
+        __m128i cells = _mm_setzero_si128();
+        for (int type = 1; type < MATERIAL_COUNT; type++)
+        {
+            __m128i bits = _mm_shuffle_epi8(_mm_set1_epi32(static_cast<int>(planes[type * stride] >> i)), spread);
+            __m128i hit = _mm_cmpeq_epi8(_mm_and_si128(bits, select), select);
+            cells = _mm_or_si128(cells, _mm_and_si128(hit, _mm_set1_epi8(static_cast<char>(type))));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(t + i), cells);
+    }
+#elif defined(__wasm_simd128__)
+    const v128_t spread = wasm_i8x16_make(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const v128_t select = wasm_i64x2_splat(static_cast<int64_t>(0x8040201008040201ull));
+    for (; i < 64; i += 16)
+    {
+        v128_t cells = wasm_i8x16_splat(0);
+        for (int type = 1; type < MATERIAL_COUNT; type++)
+        {
+            v128_t bits = wasm_i8x16_swizzle(wasm_i32x4_splat(static_cast<int32_t>(planes[type * stride] >> i)), spread);
+            v128_t hit = wasm_i8x16_eq(wasm_v128_and(bits, select), select);
+            cells = wasm_v128_or(cells, wasm_v128_and(hit, wasm_i8x16_splat(static_cast<int8_t>(type))));
+        }
+        wasm_v128_store(t + i, cells);
+    }
+#endif
+
+    for (; i < 64; i++)
+    {
+        int type = 0;
+        while (!(planes[type * stride] >> i & 1))
+            type++;
+        t[i] = static_cast<uint8_t>(type);
+    }
+}
+
+// Zeroes values[i] for each bit i set in mask
+static void clearValues(uint16_t *values, uint64_t mask)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i select = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    for (; i < 64; i += 8)
+    {
+        __m128i bits = _mm_and_si128(_mm_set1_epi16(static_cast<short>(mask >> i & 0xFF)), select);
+        __m128i *v = reinterpret_cast<__m128i *>(values + i);
+        _mm_storeu_si128(v, _mm_andnot_si128(_mm_cmpeq_epi16(bits, select), _mm_loadu_si128(v)));
+    }
+#elif defined(__wasm_simd128__)
+    const v128_t select = wasm_i16x8_make(1, 2, 4, 8, 16, 32, 64, 128);
+    for (; i < 64; i += 8)
+    {
+        v128_t bits = wasm_v128_and(wasm_i16x8_splat(static_cast<int16_t>(mask >> i & 0xFF)), select);
+        wasm_v128_store(values + i, wasm_v128_andnot(wasm_v128_load(values + i), wasm_i16x8_eq(bits, select)));
+    }
+#endif
+
+    for (; i < 64; i++)
+    {
+        if (mask >> i & 1)
+            values[i] = 0;
+    }
+}
+
+BitplaneRows::BitplaneRows(int width)
+    : m_width(width), m_words((width + 63) / 64),
+      m_planes(2 * MATERIAL_COUNT * m_words, 0), m_loaded(m_planes.size(), 0),
+      m_moved(m_words, 0), m_retry(m_words, 0), m_scratch(8 * m_words, 0)
+{
+}
+
+void BitplaneRows::load(const PixelType *upper, const PixelType *lower, int first, int last, bool lowerHeld)
+{
+    if (!lowerHeld || first != m_first || last != m_last)
+    {
+        m_first = first;
+        m_last = last;
+        loadRow(LOWER, lower);
+    }
+    loadRow(UPPER, upper);
+}
+
+void BitplaneRows::loadRow(Row row, const PixelType *types)
+{
+    for (int w = m_first; w <= m_last; w++)
+    {
+        packWord(types + w * 64, std::min(m_width - w * 64, 64), plane(row, 0) + w, m_words);
+        for (int type = 0; type < MATERIAL_COUNT; type++)
+            m_loaded[(row * MATERIAL_COUNT + type) * m_words + w] = plane(row, type)[w];
+    }
+}
+
+int BitplaneRows::store(Row row, PixelType *types, uint16_t *values, uint64_t *changed)
+{
+    const uint64_t *planes = plane(row, 0);
+    uint64_t *loaded = &m_loaded[row * MATERIAL_COUNT * m_words];
+    int filled = 0;
+    for (int w = m_first; w <= m_last; w++)
+    {
+        uint64_t diff = 0;
+        for (int type = 0; type < MATERIAL_COUNT; type++)
+        {
+            diff |= planes[type * m_words + w] ^ loaded[type * m_words + w];
+            loaded[type * m_words + w] = planes[type * m_words + w];
+        }
+        changed[w] = diff;
+        if (!diff)
+            continue;
+        filled += std::popcount(diff & ~planes[EMPTY * m_words + w]);
+
+        // Busy words are rewritten whole, the rest one changed cell at a time
+        if (std::popcount(diff) > 8 && m_width - w * 64 >= 64)
+        {
+            unpackWord(planes + w, m_words, types + w * 64);
+            clearValues(values + w * 64, diff);
+            continue;
+        }
+        while (diff)
+        {
+            int i = std::countr_zero(diff);
+            diff &= diff - 1;
+            values[w * 64 + i] = 0;
+            int type = 0;
+            while (!(planes[type * m_words + w] >> i & 1))
+                type++;
+            types[w * 64 + i] = static_cast<PixelType>(type);
+        }
+    }
+    return filled;
+}
+
+void BitplaneRows::moveUp()
+{
+    for (int type = 0; type < MATERIAL_COUNT; type++)
+    {
+        std::copy(plane(UPPER, type) + m_first, plane(UPPER, type) + m_last + 1, plane(LOWER, type) + m_first);
+        std::copy_n(&m_loaded[type * m_words + m_first], m_last - m_first + 1,
+                    &m_loaded[(MATERIAL_COUNT + type) * m_words + m_first]);
+    }
+}
+
+int BitplaneRows::step(const uint64_t *awake, const uint64_t *random)
+{
+    std::fill(m_moved.begin() + m_first, m_moved.begin() + m_last + 1, 0);
+    std::fill(m_retry.begin() + m_first, m_retry.begin() + m_last + 1, 0);
+    int moves = 0;
+    for (int i = 0; i < FALL_ORDER.count; i++)
+        moves += stepMaterial(FALL_ORDER.types[i], awake, random);
+    return moves;
+}
+
+int BitplaneRows::stepMaterial(int type, const uint64_t *awake, const uint64_t *random)
+{
+    const MaterialTraits &m = MATERIALS[type];
+    uint64_t *cand = scratch(0);
+    uint64_t *floating = scratch(1);
+    uint64_t *open = scratch(2);
+    uint64_t *movers = scratch(3);
+    uint64_t *runs[2] = {scratch(4), scratch(5)}; // left, right
+
+    uint64_t any = 0;
+    for (int w = m_first; w <= m_last; w++)
+    {
+        cand[w] = plane(UPPER, type)[w] & awake[w] & ~m_moved[w];
+        any |= cand[w];
+    }
+    if (!any)
+        return 0;
+
+    // A liquid resting on a denser liquid floats: it only spreads over the surface, and only
+    // next to another cell of its own
+    const uint64_t *same = plane(UPPER, type);
+    for (int w = m_first; w <= m_last; w++)
+    {
+        uint64_t denser = 0;
+        for (int t = 0; t < MATERIAL_COUNT && m.kind == MoveKind::LIQUID; t++)
+        {
+            if (MATERIALS[t].kind == MoveKind::LIQUID && MATERIALS[t].density > m.density)
+                denser |= plane(LOWER, t)[w];
+        }
+        floating[w] = cand[w] & denser & (shifted(same, w, -1) | shifted(same, w, 1));
+        cand[w] &= ~denser;
+    }
+
+    // Straight down
+    int moves = 0;
+    displaceable(type, open);
+    for (int w = m_first; w <= m_last; w++)
+    {
+        movers[w] = cand[w] & open[w];
+        cand[w] &= ~movers[w];
+        moves += std::popcount(movers[w]);
+    }
+    moveDown(type, movers, 0);
+
+    // Down the diagonal on each cell's random side, liquids that can't run along the row instead
+    for (int side = 0; side < 2; side++)
+    {
+        int dx = side == 0 ? -1 : 1;
+        displaceable(type, open);
+        for (int w = m_first; w <= m_last; w++)
+        {
+            uint64_t towards = side == 0 ? random[w] : ~random[w];
+            uint64_t want = cand[w] & towards;
+            movers[w] = want & shifted(open, w, dx);
+            runs[side][w] = (want & ~movers[w]) | (floating[w] & towards);
+            moves += std::popcount(movers[w]);
+
+            // Blocked this way with the other diagonal open
+            m_retry[w] |= want & ~movers[w] & shifted(open, w, -dx);
+        }
+        moveDown(type, movers, dx);
+    }
+
+    // Runs along the upper row never change what the lower row will take
+    if (m.dispersion > 0)
+        displaceable(type, open);
+    for (int side = 0; side < 2 && m.dispersion > 0; side++)
+    {
+        int dx = side == 0 ? -1 : 1;
+        uint64_t *run = runs[side];
+        for (int step = 1; step <= m.dispersion; step++)
+        {
+            const uint64_t *empty = plane(UPPER, EMPTY);
+            any = 0;
+            for (int w = m_first; w <= m_last; w++)
+            {
+                movers[w] = run[w] & shifted(empty, w, dx);
+                any |= movers[w];
+                if (step == 1)
+                    moves += std::popcount(movers[w]);
+            }
+            if (!any)
+                break;
+            moveAcross(type, movers, dx);
+
+            // Carry on from the new cell unless it stands over a drop, where it falls next frame
+            for (int w = m_first; w <= m_last; w++)
+                run[w] = shifted(movers, w, -dx) & ~open[w];
+        }
+    }
+    return moves;
+}
+
+void BitplaneRows::displaceable(int type, uint64_t *out)
+{
+    std::fill(out + m_first, out + m_last + 1, 0);
+    for (int t = 0; t < MATERIAL_COUNT; t++)
+    {
+        if (!DISPLACEMENT.canDisplace[type][t])
+            continue;
+        const uint64_t *lower = plane(LOWER, t);
+        for (int w = m_first; w <= m_last; w++)
+            out[w] |= lower[w];
+    }
+}
+
+void BitplaneRows::moveDown(int type, const uint64_t *movers, int dx)
+{
+    uint64_t *dest = scratch(6);
+    uint64_t *taken = scratch(7);
+    uint64_t any = 0;
+    for (int w = m_first; w <= m_last; w++)
+    {
+        dest[w] = shifted(movers, w, -dx);
+        any |= dest[w];
+    }
+    if (!any)
+        return;
+
+    // Whatever each mover displaced takes its old place in the upper row
+    for (int t = 0; t < MATERIAL_COUNT; t++)
+    {
+        if (!DISPLACEMENT.canDisplace[type][t])
+            continue;
+        uint64_t *lower = plane(LOWER, t);
+        for (int w = m_first; w <= m_last; w++)
+        {
+            taken[w] = dest[w] & lower[w];
+            lower[w] &= ~taken[w];
+        }
+        uint64_t *upper = plane(UPPER, t);
+        for (int w = m_first; w <= m_last; w++)
+        {
+            uint64_t back = shifted(taken, w, dx);
+            upper[w] |= back;
+            if (t != EMPTY)
+                m_moved[w] |= back;
+        }
+    }
+
+    uint64_t *upper = plane(UPPER, type);
+    uint64_t *lower = plane(LOWER, type);
+    for (int w = m_first; w <= m_last; w++)
+    {
+        upper[w] &= ~movers[w];
+        lower[w] |= dest[w];
+    }
+}
+
+void BitplaneRows::moveAcross(int type, const uint64_t *movers, int dx)
+{
+    uint64_t *cells = plane(UPPER, type);
+    uint64_t *empty = plane(UPPER, EMPTY);
+    for (int w = m_first; w <= m_last; w++)
+    {
+        uint64_t dest = shifted(movers, w, -dx);
+        cells[w] = (cells[w] & ~movers[w]) | dest;
+        empty[w] = (empty[w] & ~dest) | movers[w];
+        m_moved[w] |= dest;
+    }
+}
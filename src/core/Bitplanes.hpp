@@ -0,0 +1,82 @@
+#pragma once
+#include "Materials.hpp"
+#include <cstdint>
+#include <vector>
+
+// Two neighbouring grid rows held as one bit per cell per material, 64 cells to a word with
+// bit i of word w standing for cell 64w + i. Every falling cell of the upper row moves at once
+// with shifts and masks: one cell down, else one down a diagonal, else liquids run up to their
+// dispersion sideways. The moves follow PixelWorld's scalar kernel except that every fall is a
+// single cell, so velocity plays no part.
+class BitplaneRows
+{
+public:
+    // Rows of width cells; bits past the width belong to no material and never take a cell
+    explicit BitplaneRows(int width);
+
+    int words() const { return m_words; }
+
+    // Unpacks words first..last of two rows of cells, the span the next step works on. The
+    // lower row is kept as stepped when lowerHeld says moveUp left it there over the same span.
+    void load(const PixelType *upper, const PixelType *lower, int first, int last, bool lowerHeld);
+
+    // Moves the falling cells of the upper row whose awake bit is set, densest material first.
+    // Every awake word needs a loaded word on each side, unless it is at the grid's edge, as
+    // cells move into those. random holds one word per word of the row: a set bit sends that
+    // cell left, else right. Returns the number of moves made.
+    int step(const uint64_t *awake, const uint64_t *random);
+    // Upper row cells the last step sent down a blocked diagonal while the other was open, one
+    // word per word of the row. They have to stay awake to try again.
+    const uint64_t *retry() const { return m_retry.data(); }
+
+    // Writes the cells of the span that changed since the row was loaded back over types,
+    // zeroing their values, and sets changed for each word of the span. Returns
+    // how many of the written cells hold a material.
+    int storeLower(PixelType *types, uint16_t *values, uint64_t *changed) { return store(LOWER, types, values, changed); }
+    int storeUpper(PixelType *types, uint16_t *values, uint64_t *changed) { return store(UPPER, types, values, changed); }
+
+    // The upper row becomes the lower one, ready for the row above to be loaded
+    void moveUp();
+
+private:
+    enum Row
+    {
+        UPPER,
+        LOWER,
+    };
+
+    int m_width, m_words;
+    int m_first = 0, m_last = -1; // words of the loaded span
+    // Row r's plane for material m starts at ((r * MATERIAL_COUNT) + m) * m_words
+    std::vector<uint64_t> m_planes;
+    std::vector<uint64_t> m_loaded; // the planes as of the last load or store
+    std::vector<uint64_t> m_moved;  // upper row cells that already moved this step
+    std::vector<uint64_t> m_retry;  // see retry()
+    std::vector<uint64_t> m_scratch;
+
+    uint64_t *plane(Row row, int type) { return &m_planes[(row * MATERIAL_COUNT + type) * m_words]; }
+    uint64_t *scratch(int i) { return &m_scratch[i * m_words]; }
+
+    void loadRow(Row row, const PixelType *types);
+    int store(Row row, PixelType *types, uint16_t *values, uint64_t *changed);
+    int stepMaterial(int type, const uint64_t *awake, const uint64_t *random);
+
+    // Word w of a plane seen from dx cells away, bit i holding cell 64w + i + dx. Words
+    // outside the span read as empty.
+    uint64_t shifted(const uint64_t *plane, int w, int dx) const
+    {
+        if (dx < 0)
+            return (plane[w] << 1) | (w > m_first ? plane[w - 1] >> 63 : 0);
+        if (dx > 0)
+            return (plane[w] >> 1) | (w < m_last ? plane[w + 1] << 63 : 0);
+        return plane[w];
+    }
+
+    // Lower row cells the material can move into
+    void displaceable(int type, uint64_t *out);
+    // Moves the cells in movers, lower row cells at dx of each upper row cell, into the lower
+    // row and whatever was there back up in their place
+    void moveDown(int type, const uint64_t *movers, int dx);
+    // Moves the cells in movers one cell along the upper row, which must be empty there
+    void moveAcross(int type, const uint64_t *movers, int dx);
+};
@@ -0,0 +1,320 @@
+#include "ChunkStore.hpp"
+#include "Profiler.hpp"
+#include "Snapshot.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+// Threads are unavailable in single-threaded WebAssembly builds, chunk I/O happens inline there
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define CHUNKSTORE_INLINE_IO
+#endif
+
+// Spare buffers kept for reuse, the rest are freed
+static const size_t POOL_SPARES = 64;
+
+static constexpr int CHUNK_SIZE = PixelWorld::CHUNK_SIZE;
+
+ChunkStore::ChunkStore(const std::string &directory, int residentLimit, Generator generate)
+    : m_directory(directory), m_residentLimit(std::max(residentLimit, 0)), m_generate(std::move(generate))
+{
+    // Chunks saved by earlier sessions are part of the world
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    for (const auto &file : std::filesystem::directory_iterator(m_directory, error))
+    {
+        int cx, cy;
+        std::string name = file.path().filename().string();
+        if (name.ends_with(".pxw") && sscanf(name.c_str(), "%d_%d.pxw", &cx, &cy) == 2)
+            m_saved.insert(keyOf(cx, cy));
+    }
+
+#ifndef CHUNKSTORE_INLINE_IO
+    m_worker = std::thread(&ChunkStore::workerLoop, this);
+#endif
+}
+
+ChunkStore::~ChunkStore()
+{
+    flush(true);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    if (m_worker.joinable())
+        m_worker.join();
+}
+
+std::string ChunkStore::pathOf(uint64_t key) const
+{
+    int cx = static_cast<int>(static_cast<uint32_t>(key >> 32));
+    int cy = static_cast<int>(static_cast<uint32_t>(key));
+    return m_directory + "/" + std::to_string(cx) + "_" + std::to_string(cy) + ".pxw";
+}
+
+void ChunkStore::take(int cx, int cy, ChunkCells &cells)
+{
+    const uint64_t key = keyOf(cx, cy);
+    collect();
+
+    if (!m_resident.contains(key) && m_saved.contains(key))
+    {
+        // Usually prefetched already; otherwise this is the one place the caller waits on disk
+        if (!m_reading.contains(key))
+        {
+            m_reading.insert(key);
+            enqueue({JobKind::READ, key, nullptr});
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [&] { return m_loaded.contains(key); });
+        }
+        collect();
+    }
+
+    auto it = m_resident.find(key);
+    if (it != m_resident.end())
+    {
+        cells = *it->second.cells;
+        release(std::move(it->second.cells));
+        m_resident.erase(it);
+    }
+    else if (m_generate)
+    {
+        m_generate(cx, cy, cells);
+    }
+    else
+    {
+        cells.clear();
+    }
+}
+
+void ChunkStore::put(int cx, int cy, const ChunkCells &cells)
+{
+    const uint64_t key = keyOf(cx, cy);
+
+    // A page-in still under way would bring back older cells
+    m_reading.erase(key);
+
+    // Chunks nobody changed are rebuilt on demand and need neither memory nor a file
+    bool pristine;
+    if (m_generate)
+    {
+        std::unique_ptr<ChunkCells> generated = allocate();
+        m_generate(cx, cy, *generated);
+        pristine = memcmp(generated->types, cells.types, sizeof(cells.types)) == 0 &&
+                   memcmp(generated->values, cells.values, sizeof(cells.values)) == 0;
+        release(std::move(generated));
+    }
+    else
+    {
+        pristine = cells.empty();
+    }
+
+    if (pristine)
+    {
+        auto it = m_resident.find(key);
+        if (it != m_resident.end())
+        {
+            release(std::move(it->second.cells));
+            m_resident.erase(it);
+        }
+        if (m_saved.erase(key))
+            enqueue({JobKind::REMOVE, key, nullptr});
+        return;
+    }
+
+    Entry &entry = m_resident[key];
+    if (!entry.cells)
+        entry.cells = allocate();
+    *entry.cells = cells;
+    entry.lastUse = ++m_useClock;
+    entry.dirty = true;
+}
+
+void ChunkStore::prefetch(int cx, int cy)
+{
+    const uint64_t key = keyOf(cx, cy);
+    if (m_resident.contains(key) || m_reading.contains(key) || !m_saved.contains(key))
+        return;
+    m_reading.insert(key);
+    enqueue({JobKind::READ, key, nullptr});
+}
+
+void ChunkStore::trim()
+{
+    collect();
+    if (static_cast<int>(m_resident.size()) <= m_residentLimit)
+        return;
+
+    std::vector<std::pair<uint64_t, uint64_t>> byUse; // last use, key
+    byUse.reserve(m_resident.size());
+    for (const auto &[key, entry] : m_resident)
+        byUse.push_back({entry.lastUse, key});
+    size_t excess = m_resident.size() - m_residentLimit;
+    std::nth_element(byUse.begin(), byUse.begin() + excess, byUse.end());
+
+    for (size_t i = 0; i < excess; i++)
+    {
+        auto it = m_resident.find(byUse[i].second);
+        if (it->second.dirty)
+        {
+            m_saved.insert(it->first);
+            enqueue({JobKind::WRITE, it->first, std::move(it->second.cells)});
+        }
+        else
+        {
+            release(std::move(it->second.cells));
+        }
+        m_resident.erase(it);
+    }
+}
+
+void ChunkStore::flush(bool wait)
+{
+    collect();
+    for (auto &[key, entry] : m_resident)
+    {
+        if (!entry.dirty)
+            continue;
+        std::unique_ptr<ChunkCells> copy = allocate();
+        *copy = *entry.cells;
+        m_saved.insert(key);
+        enqueue({JobKind::WRITE, key, std::move(copy)});
+        entry.dirty = false;
+    }
+
+    if (wait)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+    }
+}
+
+std::unique_ptr<ChunkCells> ChunkStore::allocate()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_pool.empty())
+        {
+            std::unique_ptr<ChunkCells> cells = std::move(m_pool.back());
+            m_pool.pop_back();
+            return cells;
+        }
+    }
+    return std::make_unique<ChunkCells>();
+}
+
+void ChunkStore::release(std::unique_ptr<ChunkCells> cells)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pool.size() < POOL_SPARES)
+        m_pool.push_back(std::move(cells));
+}
+
+void ChunkStore::enqueue(Job &&job)
+{
+#ifdef CHUNKSTORE_INLINE_IO
+    runJob(job);
+#else
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_wake.notify_one();
+#endif
+}
+
+void ChunkStore::runJob(Job &job)
+{
+    PROFILE_SCOPE("chunks.io");
+    const std::string path = pathOf(job.key);
+    switch (job.kind)
+    {
+    case JobKind::READ:
+    {
+        // A missing or broken file comes back as null, take() then falls back to the generator
+        WorldFrame frame;
+        std::unique_ptr<ChunkCells> cells;
+        if (loadSnapshot(path, frame) && frame.width == CHUNK_SIZE && frame.height == CHUNK_SIZE)
+        {
+            cells = allocate();
+            std::copy(frame.types.begin(), frame.types.end(), cells->types);
+            std::copy(frame.values.begin(), frame.values.end(), cells->values);
+        }
+        else
+        {
+            fprintf(stderr, "CHUNKSTORE: failed to read %s\n", path.c_str());
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loaded[job.key] = std::move(cells);
+        break;
+    }
+    case JobKind::WRITE:
+    {
+        WorldFrame frame;
+        frame.width = CHUNK_SIZE;
+        frame.height = CHUNK_SIZE;
+        frame.types.assign(job.cells->types, job.cells->types + ChunkCells::CELLS);
+        frame.values.assign(job.cells->values, job.cells->values + ChunkCells::CELLS);
+        if (!saveSnapshot(path, frame))
+            fprintf(stderr, "CHUNKSTORE: failed to write %s\n", path.c_str());
+        release(std::move(job.cells));
+        break;
+    }
+    case JobKind::REMOVE:
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        break;
+    }
+    }
+}
+
+void ChunkStore::collect()
+{
+    std::unordered_map<uint64_t, std::unique_ptr<ChunkCells>> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_loaded.empty())
+            return;
+        loaded.swap(m_loaded);
+    }
+
+    for (auto &[key, cells] : loaded)
+    {
+        // Dropped from m_reading when a put() overtook the page-in
+        if (!m_reading.erase(key) || !cells)
+        {
+            if (cells)
+                release(std::move(cells));
+            continue;
+        }
+        m_resident[key] = {std::move(cells), ++m_useClock, false};
+    }
+}
+
+void ChunkStore::workerLoop()
+{
+    PROFILE_THREAD("chunk io");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+        if (m_jobs.empty())
+            return; // only reached once stopping with nothing left to do
+
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_busy = true;
+
+        lock.unlock();
+        runJob(job);
+        lock.lock();
+
+        m_busy = false;
+        m_done.notify_all();
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "PixelWorld.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Sparse store for the chunks of a world too big to keep in memory. Chunks are keyed by their
+// chunk coordinates and live in pooled buffers; all-empty chunks are never stored. Past the
+// resident limit the least recently used chunks go to one snapshot file each in the store's
+// directory, and are paged back in on an I/O thread. Files outlive the store, so a directory
+// holds a world across sessions.
+//
+// All calls must come from one thread, only the I/O thread runs alongside it.
+class ChunkStore
+{
+public:
+    // Fills a chunk that was never saved, must give the same cells every time it is asked
+    using Generator = std::function<void(int cx, int cy, ChunkCells &cells)>;
+
+    ChunkStore(const std::string &directory, int residentLimit, Generator generate = nullptr);
+    ~ChunkStore(); // writes every changed chunk before returning
+
+    ChunkStore(const ChunkStore &) = delete;
+    ChunkStore &operator=(const ChunkStore &) = delete;
+
+    // Moves chunk cx,cy out of the store, waiting for its page-in when it isn't resident
+    void take(int cx, int cy, ChunkCells &cells);
+    // Hands chunk cx,cy to the store, replacing whatever it held
+    void put(int cx, int cy, const ChunkCells &cells);
+    // Starts paging chunk cx,cy in, unless it is resident already or was never saved
+    void prefetch(int cx, int cy);
+    // Writes the least recently used chunks out until no more than the resident limit stay
+    void trim();
+    // Queues every changed resident chunk for writing, wait blocks until they are on disk
+    void flush(bool wait);
+
+    int residentCount() const { return static_cast<int>(m_resident.size()); }
+    int savedCount() const { return static_cast<int>(m_saved.size()); }
+
+private:
+    enum class JobKind : uint8_t
+    {
+        READ,
+        WRITE,
+        REMOVE,
+    };
+
+    struct Job
+    {
+        JobKind kind;
+        uint64_t key;
+        std::unique_ptr<ChunkCells> cells; // written out for WRITE
+    };
+
+    struct Entry
+    {
+        std::unique_ptr<ChunkCells> cells;
+        uint64_t lastUse;
+        bool dirty; // differs from the chunk's file
+    };
+
+    static uint64_t keyOf(int cx, int cy) { return static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32 | static_cast<uint32_t>(cy); }
+    std::string pathOf(uint64_t key) const;
+
+    std::unique_ptr<ChunkCells> allocate();
+    void release(std::unique_ptr<ChunkCells> cells);
+    void enqueue(Job &&job);
+    void runJob(Job &job);
+    // Adopts finished page-ins as resident chunks
+    void collect();
+    void workerLoop();
+
+    std::string m_directory;
+    int m_residentLimit;
+    Generator m_generate;
+
+    // Calling thread only
+    std::unordered_map<uint64_t, Entry> m_resident;
+    std::unordered_set<uint64_t> m_saved;   // chunks with a file
+    std::unordered_set<uint64_t> m_reading; // page-ins queued or running
+    uint64_t m_useClock = 0;
+
+    // Shared with the I/O thread
+    std::mutex m_mutex;
+    std::condition_variable m_wake; // jobs queued or stopping
+    std::condition_variable m_done; // a job finished
+    std::deque<Job> m_jobs;
+    std::unordered_map<uint64_t, std::unique_ptr<ChunkCells>> m_loaded;
+    std::vector<std::unique_ptr<ChunkCells>> m_pool;
+    bool m_busy = false;
+    bool m_stopping = false;
+    std::thread m_worker;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include "Materials.hpp"
+#include <cstdint>
+#include <vector>
+
+// Density that paints every covered cell; lower densities paint each cell with density/255 odds
+constexpr uint8_t EDIT_SOLID = 255;
+// Mask cells holding this leave the world as it is
+constexpr uint8_t MASK_KEEP = 0xFF;
+
+enum class EditShape : uint8_t
+{
+    RECT,   // x0,y0 to x1,y1 inclusive
+    CIRCLE, // centre x0,y0
+    LINE,   // x0,y0 to x1,y1, radius thick with round ends
+    FLOOD,  // the region connected to x0,y0 holding the same material
+    MASK,   // mask cells from x0,y0 to x1,y1 inclusive, row by row
+    BLAST   // centre x0,y0, throws every cell within radius out as particles
+};
+
+struct EditCommand
+{
+    EditShape shape;
+    PixelType type;
+    uint8_t density;
+    int x0, y0, x1, y1;
+    int radius;
+    uint32_t mask; // offset into EditBuffer::masks()
+};
+
+// Recorded world edits, applied by PixelWorld in one pass as span writes. Recording touches
+// no world state, so any thread can fill a buffer and hand it over.
+class EditBuffer
+{
+public:
+    void fillRect(int x0, int y0, int x1, int y1, PixelType type, uint8_t density = EDIT_SOLID)
+    {
+        m_commands.push_back({EditShape::RECT, type, density, x0, y0, x1, y1, 0, 0});
+    }
+
+    void fillCircle(int x, int y, int radius, PixelType type, uint8_t density = EDIT_SOLID)
+    {
+        m_commands.push_back({EditShape::CIRCLE, type, density, x, y, x, y, radius, 0});
+    }
+
+    void strokeLine(int x0, int y0, int x1, int y1, int radius, PixelType type, uint8_t density = EDIT_SOLID)
+    {
+        m_commands.push_back({EditShape::LINE, type, density, x0, y0, x1, y1, radius, 0});
+    }
+
+    // Always solid, a partial fill would leave cells the fill is still looking for
+    void floodFill(int x, int y, PixelType type)
+    {
+        m_commands.push_back({EditShape::FLOOD, type, EDIT_SOLID, x, y, x, y, 0, 0});
+    }
+
+    // Knocks every cell within radius loose, flung away from the centre
+    void explode(int x, int y, int radius)
+    {
+        m_commands.push_back({EditShape::BLAST, PixelType::EMPTY, EDIT_SOLID, x, y, x, y, radius, 0});
+    }
+
+    // cells holds width * height PixelType values or MASK_KEEP, placed with its top left at x,y
+    void stampMask(int x, int y, int width, int height, const uint8_t *cells)
+    {
+        if (width <= 0 || height <= 0)
+            return;
+        uint32_t offset = static_cast<uint32_t>(m_masks.size());
+        m_masks.insert(m_masks.end(), cells, cells + width * height);
+        m_commands.push_back({EditShape::MASK, PixelType::EMPTY, EDIT_SOLID, x, y, x + width - 1, y + height - 1, 0, offset});
+    }
+
+    void append(const EditBuffer &other)
+    {
+        uint32_t offset = static_cast<uint32_t>(m_masks.size());
+        for (EditCommand command : other.m_commands)
+        {
+            command.mask += offset;
+            m_commands.push_back(command);
+        }
+        m_masks.insert(m_masks.end(), other.m_masks.begin(), other.m_masks.end());
+    }
+
+    void clear()
+    {
+        m_commands.clear();
+        m_masks.clear();
+    }
+
+    bool empty() const { return m_commands.empty(); }
+    const std::vector<EditCommand> &commands() const { return m_commands; }
+    const std::vector<uint8_t> &masks() const { return m_masks; }
+
+private:
+    std::vector<EditCommand> m_commands;
+    std::vector<uint8_t> m_masks;
+};
@@ -0,0 +1,114 @@
+#include "HeatField.hpp"
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+HeatField::HeatField(int cellWidth, int cellHeight)
+    : m_width((cellWidth + SAMPLE - 1) / SAMPLE), m_height((cellHeight + SAMPLE - 1) / SAMPLE),
+      m_stride(m_width + 2),
+      m_heat(m_stride * (m_height + 2), 0), m_next(m_heat.size(), 0)
+{
+}
+
+int HeatField::add(int sx, int sy, int amount)
+{
+    int16_t &heat = m_heat[index(sx, sy)];
+    heat = static_cast<int16_t>(std::clamp(heat + amount, -MAX_HEAT, MAX_HEAT));
+    return heat;
+}
+
+void HeatField::clear()
+{
+    std::fill(m_heat.begin(), m_heat.end(), 0);
+    m_active = false;
+}
+
+void HeatField::shift(int dx, int dy)
+{
+    std::fill(m_next.begin(), m_next.end(), 0);
+    int x0 = std::max(-dx, 0), x1 = std::min(m_width - dx, m_width);
+    for (int y = std::max(-dy, 0); y < std::min(m_height - dy, m_height) && x0 < x1; y++)
+        std::copy_n(&m_heat[index(x0 + dx, y + dy)], x1 - x0, &m_next[index(x0, y)]);
+    m_heat.swap(m_next);
+}
+
+void HeatField::fillBorder()
+{
+    std::copy_n(&m_heat[index(0, 0)], m_width, &m_heat[index(0, -1)]);
+    std::copy_n(&m_heat[index(0, m_height - 1)], m_width, &m_heat[index(0, m_height)]);
+    for (int y = 0; y < m_height; y++)
+    {
+        m_heat[index(-1, y)] = m_heat[index(0, y)];
+        m_heat[index(m_width, y)] = m_heat[index(m_width - 1, y)];
+    }
+}
+
+// Half stays, an eighth comes from each neighbour, then a 1/64 drift towards ambient of at
+// least one degree, or warm samples below 64 would never cool. The floored shift already
+// moves cold ones by one. Sums stay within 8 * MAX_HEAT, so 16-bit lanes give the same
+// result as this.
+static inline int16_t diffuse(int centre, int up, int down, int left, int right)
+{
+    int heat = (4 * centre + up + down + left + right) >> 3;
+    return static_cast<int16_t>(heat - std::max(heat >> HeatField::DECAY_SHIFT, std::min(heat, 1)));
+}
+
+void HeatField::step()
+{
+    static_assert(8 * MAX_HEAT <= INT16_MAX, "stencil sums must fit 16-bit lanes");
+
+    fillBorder();
+    bool active = false;
+    for (int y = 0; y < m_height; y++)
+    {
+        const int16_t *row = &m_heat[index(0, y)];
+        const int16_t *up = row - m_stride;
+        const int16_t *down = row + m_stride;
+        int16_t *out = &m_next[index(0, y)];
+        int x = 0;
+
+#if defined(__SSE2__)
+        __m128i any = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi16(1);
+        for (; m_vectorised && x + 8 <= m_width; x += 8)
+        {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+            __m128i sum = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(up + x)),
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(down + x)));
+            sum = _mm_add_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x - 1)));
+            sum = _mm_add_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x + 1)));
+            __m128i heat = _mm_srai_epi16(_mm_add_epi16(sum, _mm_slli_epi16(c, 2)), 3);
+            heat = _mm_sub_epi16(heat, _mm_max_epi16(_mm_srai_epi16(heat, DECAY_SHIFT), _mm_min_epi16(heat, one)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), heat);
+            any = _mm_or_si128(any, heat);
+        }
+        active |= _mm_movemask_epi8(_mm_cmpeq_epi16(any, _mm_setzero_si128())) != 0xFFFF;
+#elif defined(__wasm_simd128__)
+        v128_t any = wasm_i16x8_splat(0);
+        const v128_t one = wasm_i16x8_splat(1);
+        for (; m_vectorised && x + 8 <= m_width; x += 8)
+        {
+            v128_t c = wasm_v128_load(row + x);
+            v128_t sum = wasm_i16x8_add(wasm_v128_load(up + x), wasm_v128_load(down + x));
+            sum = wasm_i16x8_add(sum, wasm_v128_load(row + x - 1));
+            sum = wasm_i16x8_add(sum, wasm_v128_load(row + x + 1));
+            v128_t heat = wasm_i16x8_shr(wasm_i16x8_add(sum, wasm_i16x8_shl(c, 2)), 3);
+            heat = wasm_i16x8_sub(heat, wasm_i16x8_max(wasm_i16x8_shr(heat, DECAY_SHIFT), wasm_i16x8_min(heat, one)));
+            wasm_v128_store(out + x, heat);
+            any = wasm_v128_or(any, heat);
+        }
+        active |= wasm_v128_any_true(any);
+#endif
+        for (; x < m_width; x++)
+        {
+            out[x] = diffuse(row[x], up[x], down[x], row[x - 1], row[x + 1]);
+            active |= out[x] != 0;
+        }
+    }
+    m_heat.swap(m_next);
+    m_active = active;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Coarse temperature grid laid over the cells, one sample per SAMPLE x SAMPLE block. Heat is
+// in whole degrees above ambient, negative where water cooled it, so seeded runs never depend
+// on float rounding. Each step blends every sample with its 4 neighbours and lets it drift
+// back towards ambient; the edges of the grid are insulated.
+class HeatField
+{
+public:
+    static constexpr int SAMPLE = 8;         // cells per side of a sample, divides CHUNK_SIZE
+    static constexpr int MAX_HEAT = 4095;    // keeps the stencil's 8x sum inside 16 bits
+    static constexpr int DECAY_SHIFT = 6;    // loses 1/64 of its distance to ambient per step
+    // Every sample moves at least a degree towards ambient per step, so a field left alone
+    // is back at ambient within this many steps
+    static constexpr int SETTLE_STEPS = MAX_HEAT;
+
+    // Sized to cover a grid of cells, partial blocks at the edges get a whole sample
+    HeatField(int cellWidth, int cellHeight);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    int at(int sx, int sy) const { return m_heat[index(sx, sy)]; }
+    int atCell(int x, int y) const { return at(x / SAMPLE, y / SAMPLE); }
+    // Adds to a sample, clamped to +-MAX_HEAT, and returns the new heat. Workers may add to
+    // different samples at once.
+    int add(int sx, int sy, int amount);
+    int addAtCell(int x, int y, int amount) { return add(x / SAMPLE, y / SAMPLE, amount); }
+
+    // False once a step left every sample at ambient. add() leaves it alone, whoever adds
+    // heat steps the field regardless.
+    bool active() const { return m_active; }
+
+    void clear();
+    // Slides by whole samples the way PixelWorld::moveOrigin slides cells: sample x,y becomes
+    // old sample x+dx,y+dy, and samples that scroll in start at ambient
+    void shift(int dx, int dy);
+    // One diffusion and decay step over the whole grid
+    void step();
+
+    // Off steps every sample through the scalar stencil, for checking the SIMD one against
+    void setVectorised(bool enabled) { m_vectorised = enabled; }
+
+private:
+    int m_width, m_height;
+    int m_stride;                // padded row length
+    std::vector<int16_t> m_heat; // padded by one sample on every side
+    std::vector<int16_t> m_next;
+    bool m_active = false;
+    bool m_vectorised = true;
+
+    int index(int sx, int sy) const { return (sy + 1) * m_stride + sx + 1; }
+    // Copies the edge samples into the padding, so heat never flows out of the grid
+    void fillBorder();
+};
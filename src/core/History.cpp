@@ -0,0 +1,299 @@
+#include "History.hpp"
+#include "Snapshot.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+// Replaying deltas worth more than this many keyframes costs more than decoding a new one
+static const size_t KEYFRAME_RATIO = 4;
+
+// High bit of each byte of x that is not zero
+static uint64_t nonzeroBytes(uint64_t x)
+{
+    return (((x & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | x) & 0x8080808080808080ull;
+}
+
+// Bit k set where cell i + k differs from the recorded one in type or raw value, for
+// n <= 64 cells. Changed rects sit within a chunk, so one of their rows always fits.
+static uint64_t differingCells(const PixelView &view, const WorldFrame &last, int i, int n)
+{
+    uint64_t mask = 0;
+    int k = 0;
+    for (; k + 8 <= n; k += 8)
+    {
+        uint64_t types, lastTypes, values[2], lastValues[2];
+        std::memcpy(&types, view.types + i + k, sizeof(types));
+        std::memcpy(&lastTypes, last.types.data() + i + k, sizeof(lastTypes));
+        std::memcpy(values, view.values + i + k, sizeof(values));
+        std::memcpy(lastValues, last.values.data() + i + k, sizeof(lastValues));
+
+        // Gather the byte flags into 8 bits, then each value's two byte flags into one
+        uint64_t bits = ((nonzeroBytes(types ^ lastTypes) >> 7) * 0x0102040810204080ull) >> 56;
+        for (int half = 0; half < 2; half++)
+        {
+            uint64_t v = nonzeroBytes(values[half] ^ lastValues[half]) >> 7;
+            v |= v >> 8; // either byte of a value, onto its low byte
+            uint64_t lanes = (v & 1) | (v >> 15 & 2) | (v >> 30 & 4) | (v >> 45 & 8);
+            bits |= lanes << (4 * half);
+        }
+        mask |= bits << k;
+    }
+    for (; k < n; k++)
+    {
+        if (view.types[i + k] != last.types[i + k] || view.values[i + k] != last.values[i + k])
+            mask |= 1ull << k;
+    }
+    return mask;
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+// Records never leave memory, so reading them needs no bounds checks
+struct DeltaReader
+{
+    const uint8_t *p;
+
+    uint8_t u8() { return *p++; }
+    uint16_t u16()
+    {
+        uint16_t lo = u8();
+        return static_cast<uint16_t>(lo | (u8() << 8));
+    }
+    uint32_t varint()
+    {
+        uint32_t v = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            uint8_t b = u8();
+            v |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+    }
+};
+
+void WorldHistory::setBudget(size_t budget)
+{
+    m_budget = budget;
+    if (m_budget == 0)
+        clear();
+    else
+        trim();
+}
+
+void WorldHistory::clear()
+{
+    m_records.clear();
+    m_bytes = 0;
+    m_keyframes = 0;
+}
+
+void WorldHistory::record(const PixelView &view, const std::vector<DirtyRect> &changed, uint64_t tick)
+{
+    if (m_budget == 0)
+        return;
+
+    // Records are found by their distance from the oldest tick, which a gap would break
+    if (!m_records.empty() && tick != newestTick() + 1)
+        clear();
+
+    bool keyframe = m_records.empty() ||
+                    view.width != m_last.width || view.height != m_last.height ||
+                    tick - m_keyframeTick >= KEYFRAME_INTERVAL ||
+                    m_deltaBytes > KEYFRAME_RATIO * m_keyframeBytes || m_bytes > m_budget;
+    if (keyframe)
+    {
+        recordKeyframe(view, tick);
+        trim();
+        return;
+    }
+
+    std::vector<uint8_t> rects;
+    uint32_t rectCount = 0;
+    for (const DirtyRect &rect : changed)
+    {
+        size_t start = rects.size();
+        const int width = rect.maxX - rect.minX + 1;
+        putVarint(rects, rect.minX);
+        putVarint(rects, rect.minY);
+        putVarint(rects, width - 1);
+        putVarint(rects, rect.maxY - rect.minY);
+
+        // Spans run along one row at most. end counts cells within the rect in row order, up
+        // to the one after the last span.
+        uint32_t end = 0;
+        for (int y = rect.minY; y <= rect.maxY; y++)
+        {
+            const int row = y * view.width + rect.minX;
+            const uint32_t rowCell = static_cast<uint32_t>((y - rect.minY) * width);
+            uint64_t differ = differingCells(view, m_last, row, width);
+            while (differ)
+            {
+                int x = std::countr_zero(differ);
+                int count = std::countr_one(differ >> x);
+                differ &= count == 64 ? 0 : ~(((1ull << count) - 1) << x);
+
+                uint32_t cell = rowCell + static_cast<uint32_t>(x);
+                putVarint(rects, cell - end);
+                putVarint(rects, static_cast<uint32_t>(count));
+                end = cell + static_cast<uint32_t>(count);
+
+                size_t at = rects.size();
+                rects.resize(at + 3 * count);
+                uint8_t *out = rects.data() + at;
+                for (int i = row + x; i < row + x + count; i++)
+                {
+                    PixelType type = view.types[i];
+                    uint16_t value = view.values[i];
+                    m_last.types[i] = type;
+                    m_last.values[i] = value;
+                    *out++ = static_cast<uint8_t>(type);
+                    if (valueMatters(type))
+                    {
+                        *out++ = static_cast<uint8_t>(value);
+                        *out++ = static_cast<uint8_t>(value >> 8);
+                    }
+                }
+                rects.resize(static_cast<size_t>(out - rects.data()));
+            }
+        }
+
+        // Woken cells that ended up as they were leave no trace
+        if (end == 0)
+        {
+            rects.resize(start);
+            continue;
+        }
+        putVarint(rects, 0);
+        putVarint(rects, 0);
+        rectCount++;
+    }
+
+    Record &r = m_records.emplace_back(Record{tick, false, {}});
+    putVarint(r.bytes, rectCount);
+    r.bytes.insert(r.bytes.end(), rects.begin(), rects.end());
+    m_bytes += r.bytes.size();
+    m_deltaBytes += r.bytes.size();
+    trim();
+}
+
+void WorldHistory::recordKeyframe(const PixelView &view, uint64_t tick)
+{
+    m_last.width = view.width;
+    m_last.height = view.height;
+    m_last.types.assign(view.types, view.types + view.size());
+    m_last.values.assign(view.values, view.values + view.size());
+
+    Record &r = m_records.emplace_back(Record{tick, true, {}});
+    encodeSnapshot(m_last, r.bytes);
+    m_bytes += r.bytes.size();
+    m_keyframes++;
+    m_keyframeBytes = r.bytes.size();
+    m_keyframeTick = tick;
+    m_deltaBytes = 0;
+}
+
+void WorldHistory::trim()
+{
+    auto popFront = [this]
+    {
+        m_bytes -= m_records.front().bytes.size();
+        m_keyframes -= m_records.front().keyframe;
+        m_records.pop_front();
+    };
+
+    // Past the budget a whole keyframe and its deltas go at once, the newest chain always stays
+    while (m_bytes > m_budget && m_keyframes > 1)
+    {
+        popFront();
+        while (!m_records.front().keyframe)
+            popFront();
+    }
+}
+
+void WorldHistory::truncate(uint64_t tick)
+{
+    if (m_records.empty() || tick >= newestTick())
+        return;
+    if (tick < oldestTick())
+    {
+        clear();
+        return;
+    }
+
+    while (m_records.back().tick > tick)
+    {
+        m_bytes -= m_records.back().bytes.size();
+        m_keyframes -= m_records.back().keyframe;
+        m_records.pop_back();
+    }
+    reconstruct(tick, m_last);
+
+    m_deltaBytes = 0;
+    for (auto r = m_records.rbegin(); r != m_records.rend(); ++r)
+    {
+        if (r->keyframe)
+        {
+            m_keyframeBytes = r->bytes.size();
+            m_keyframeTick = r->tick;
+            break;
+        }
+        m_deltaBytes += r->bytes.size();
+    }
+}
+
+bool WorldHistory::reconstruct(uint64_t tick, WorldFrame &frame) const
+{
+    if (m_records.empty() || tick < oldestTick() || tick > newestTick())
+        return false;
+
+    // Ticks are consecutive, so the record for tick sits at a known place
+    size_t last = static_cast<size_t>(tick - oldestTick());
+    size_t first = last;
+    while (!m_records[first].keyframe)
+        first--;
+
+    const Record &keyframe = m_records[first];
+    if (!decodeSnapshot(keyframe.bytes.data(), keyframe.bytes.size(), frame))
+        return false;
+    for (size_t i = first + 1; i <= last; i++)
+        applyDelta(m_records[i].bytes, frame);
+    return true;
+}
+
+void WorldHistory::applyDelta(const std::vector<uint8_t> &bytes, WorldFrame &frame)
+{
+    DeltaReader in{bytes.data()};
+    uint32_t rectCount = in.varint();
+    for (uint32_t r = 0; r < rectCount; r++)
+    {
+        int minX = static_cast<int>(in.varint());
+        int minY = static_cast<int>(in.varint());
+        int width = static_cast<int>(in.varint()) + 1;
+        in.varint(); // height, the spans end the rect
+
+        int cell = 0; // within the rect, in row order
+        for (;;)
+        {
+            cell += static_cast<int>(in.varint());
+            uint32_t count = in.varint();
+            if (count == 0)
+                break;
+            for (uint32_t c = 0; c < count; c++, cell++)
+            {
+                int i = (minY + cell / width) * frame.width + minX + cell % width;
+                PixelType type = static_cast<PixelType>(in.u8());
+                frame.types[i] = type;
+                frame.values[i] = valueMatters(type) ? in.u16() : 0;
+            }
+        }
+    }
+}
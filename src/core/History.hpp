@@ -0,0 +1,68 @@
+#pragma once
+#include "PixelWorld.hpp"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// The last few thousand ticks of a world, for rewinding. Each tick is kept as just the cells
+// it changed, found within the changed rects PixelWorld hands out, with a keyframe snapshot
+// every so often to replay from. The oldest ticks go once the records pass the byte budget.
+//
+// Delta records, varints as in snapshots:
+//
+//   varint  rect count
+//   rects   { varint minX, minY, width - 1, height - 1, then spans in row order until one
+//             with no changed cells: { varint unchanged, varint changed, changed cells as
+//             { u8 type, u16 value when the type uses one } } }
+//
+// Values a type never reads are left out and replay as 0, just as they load from snapshots.
+class WorldHistory
+{
+public:
+    static constexpr size_t DEFAULT_BUDGET = 32u << 20;
+    static constexpr int KEYFRAME_INTERVAL = 600; // most ticks between keyframes
+
+    explicit WorldHistory(size_t budget = DEFAULT_BUDGET) : m_budget(budget) {}
+
+    // 0 turns recording off and drops what was kept
+    void setBudget(size_t budget);
+    size_t budget() const { return m_budget; }
+    size_t bytes() const { return m_bytes; }
+
+    // Records the world as it is after tick. changed must cover everything that changed since
+    // the previous record. A gap in the ticks drops what was kept and starts over from a
+    // keyframe, so the held ticks always run without gaps.
+    void record(const PixelView &view, const std::vector<DirtyRect> &changed, uint64_t tick);
+    void clear();
+    // Forgets every tick after tick, recording carries on from there
+    void truncate(uint64_t tick);
+
+    bool empty() const { return m_records.empty(); }
+    uint64_t oldestTick() const { return m_records.front().tick; }
+    uint64_t newestTick() const { return m_records.back().tick; }
+
+    // Rebuilds the world as of a held tick, false when it is not held
+    bool reconstruct(uint64_t tick, WorldFrame &frame) const;
+
+private:
+    struct Record
+    {
+        uint64_t tick;
+        bool keyframe;
+        std::vector<uint8_t> bytes;
+    };
+
+    size_t m_budget;
+    size_t m_bytes = 0;
+    std::deque<Record> m_records;
+    int m_keyframes = 0;
+    WorldFrame m_last;          // the world as of the newest record, raw values included
+    size_t m_keyframeBytes = 0; // size of the newest keyframe
+    size_t m_deltaBytes = 0;    // delta bytes recorded since it
+    uint64_t m_keyframeTick = 0;
+
+    void recordKeyframe(const PixelView &view, uint64_t tick);
+    // Drops the oldest ticks until the budget holds, never leaving a delta at the front
+    void trim();
+    static void applyDelta(const std::vector<uint8_t> &bytes, WorldFrame &frame);
+};
@@ -0,0 +1,112 @@
+#include "Margolus.hpp"
+#include <utility>
+
+// Cells of a block, in state order
+static constexpr int TOP_LEFT = 0, TOP_RIGHT = 1, BOTTOM_LEFT = 2, BOTTOM_RIGHT = 3;
+
+static constexpr uint16_t evaluate(int variant, int state)
+{
+    PixelType cell[4] = {};
+    int from[4] = {TOP_LEFT, TOP_RIGHT, BOTTOM_LEFT, BOTTOM_RIGHT};
+    bool moved[4] = {};
+    for (int k = 0; k < 4; k++)
+    {
+        int type = state >> (k * MargolusRules::CELL_BITS) & ((1 << MargolusRules::CELL_BITS) - 1);
+        if (type >= MATERIAL_COUNT)
+            return 0; // no such block
+        cell[k] = static_cast<PixelType>(type);
+    }
+
+    auto swap = [&](int a, int b)
+    {
+        std::swap(cell[a], cell[b]);
+        std::swap(from[a], from[b]);
+        moved[a] = moved[b] = true;
+    };
+    auto canDisplace = [&](int mover, int target)
+    {
+        return !moved[target] && DISPLACEMENT.canDisplace[static_cast<int>(cell[mover])][static_cast<int>(cell[target])];
+    };
+    auto falls = [&](int k) { return !moved[k] && isFalling(cell[k]); };
+
+    // 1 when cells slide and run left, the right column then moves first
+    const int first = variant & 1;
+    const bool rise = variant & 2;
+
+    // Fire rises into empty cells, else drifts along its row
+    for (int k : {BOTTOM_LEFT + first, BOTTOM_RIGHT - first, TOP_LEFT + first, TOP_RIGHT - first})
+    {
+        if (cell[k] != PixelType::FIRE || moved[k])
+            continue;
+        int above = k - 2, side = k ^ 1;
+        if (rise && k >= BOTTOM_LEFT && cell[above] == PixelType::EMPTY && !moved[above])
+            swap(k, above);
+        else if (!rise && cell[side] == PixelType::EMPTY && !moved[side])
+            swap(k, side);
+    }
+
+    // Straight down through whatever the cell displaces
+    for (int col : {first, 1 - first})
+    {
+        if (falls(col) && canDisplace(col, col + 2))
+            swap(col, col + 2);
+    }
+
+    // Down the diagonal when the cell below holds, only the way the variant goes, as a
+    // scalar cell picks its side at random
+    if (int col = first, diagonal = (1 - col) + 2; falls(col) && canDisplace(col, diagonal))
+        swap(col, diagonal);
+
+    // Liquids that stayed run sideways the same way, the bottom row first as it holds the
+    // surface. Both ways at once would send a row of alternating cells and gaps back and
+    // forth forever, a cell and a gap in every block on either offset.
+    for (int k : {BOTTOM_LEFT + first, TOP_LEFT + first})
+    {
+        int side = k ^ 1;
+        if (falls(k) && materialTraits(cell[k]).kind == MoveKind::LIQUID && cell[side] == PixelType::EMPTY && !moved[side])
+            swap(k, side);
+    }
+
+    // Fire lights the flammable cells beside it and above or below it
+    int lit = 0;
+    for (int k = 0; k < 4; k++)
+    {
+        if (cell[k] != PixelType::FIRE)
+            continue;
+        for (int other : {k ^ 1, k ^ 2})
+        {
+            if (materialTraits(cell[other]).flammable)
+                lit |= 1 << other;
+        }
+    }
+
+    uint16_t entry = static_cast<uint16_t>(from[0] | from[1] << 2 | from[2] << 4 | from[3] << 6 | lit << 8);
+    constexpr uint16_t UNCHANGED = TOP_LEFT | TOP_RIGHT << 2 | BOTTOM_LEFT << 4 | BOTTOM_RIGHT << 6;
+    return entry == UNCHANGED ? 0 : entry;
+}
+
+static constexpr MargolusRules makeMargolusRules()
+{
+    MargolusRules rules{};
+    for (int variant = 0; variant < MargolusRules::VARIANTS; variant++)
+    {
+        for (int state = 0; state < MargolusRules::STATES; state++)
+        {
+            uint16_t entry = evaluate(variant, state);
+            rules.entries[variant][state] = entry;
+            for (int k = BOTTOM_LEFT; k <= BOTTOM_RIGHT && entry != 0; k++)
+            {
+                if (MargolusRules::source(entry, k) < BOTTOM_LEFT)
+                    rules.drops[state] = true;
+            }
+        }
+    }
+    return rules;
+}
+
+static constexpr MargolusRules MARGOLUS_RULES = makeMargolusRules();
+
+const MargolusRules &margolusRules()
+{
+    return MARGOLUS_RULES;
+}
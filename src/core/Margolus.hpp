@@ -0,0 +1,42 @@
+#pragma once
+#include "Materials.hpp"
+#include <cstdint>
+
+// Rules for 2x2 blocks of cells, as in a Margolus neighbourhood. The four cells of a block,
+// top left, top right, bottom left, bottom right, pick an entry that says where each of them
+// ends up and which catch fire. Blocks never overlap within a pass and the block grid shifts
+// by a cell between passes, so cells trade across every block edge in turn while each block
+// updates on its own, in any order and on any thread.
+//
+// The rules follow PixelWorld's scalar kernels a cell at a time: fire rises or drifts into
+// empty cells and lights what it touches, falling cells drop through what they displace,
+// else slide down a diagonal, and liquids run sideways into empty cells. Falls are a single
+// cell, so velocity plays no part. Fire burning down stays with the caller, it needs time and
+// the heat field.
+struct MargolusRules
+{
+    static constexpr int CELL_BITS = 3;
+    static constexpr int STATES = 1 << (4 * CELL_BITS);
+    // Blocks pick a variant from two random bits: bit 0 sends moves left rather than right,
+    // bit 1 has fire rise rather than drift sideways
+    static constexpr int VARIANTS = 4;
+
+    // 0 when the block stays as it is. Otherwise bits 2k..2k+1 name the cell that moves to
+    // cell k, and bit 8 + k lights cell k.
+    uint16_t entries[VARIANTS][STATES];
+    // Set where some variant drops a cell a row. Diagonals depend on the variant, so a block
+    // that stayed put under one of these has to try again.
+    bool drops[STATES];
+
+    static constexpr int state(PixelType topLeft, PixelType topRight, PixelType bottomLeft, PixelType bottomRight)
+    {
+        return static_cast<int>(topLeft) | static_cast<int>(topRight) << CELL_BITS |
+               static_cast<int>(bottomLeft) << (2 * CELL_BITS) | static_cast<int>(bottomRight) << (3 * CELL_BITS);
+    }
+    static constexpr int source(uint16_t entry, int cell) { return entry >> (2 * cell) & 3; }
+    static constexpr bool lights(uint16_t entry, int cell) { return entry >> (8 + cell) & 1; }
+};
+
+static_assert(MATERIAL_COUNT <= 1 << MargolusRules::CELL_BITS, "block states hold a material in CELL_BITS");
+
+const MargolusRules &margolusRules();
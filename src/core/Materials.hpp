@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+enum class PixelType : uint8_t
+{
+    EMPTY,
+    SAND,
+    WATER,
+    STONE,
+    FIRE,
+    OIL,
+};
+
+constexpr int MATERIAL_COUNT = 6;
+
+// Fire never falls and falling materials never burn, so both share one 16-bit value per cell.
+// Values are integer steps so a seeded run never depends on float rounding.
+constexpr int VELOCITY_SCALE = 200;  // steps per cell/frame, exact for every gravity and velocity cap
+constexpr int LIFETIME_SCALE = 4096; // steps per second
+
+enum class MoveKind : uint8_t
+{
+    STATIC, // never moves on its own
+    POWDER, // falls and slides down diagonals
+    LIQUID, // falls, slides and spreads sideways
+    FIRE,   // rises, spreads and burns out
+};
+
+struct MaterialTraits
+{
+    const char *name;
+    MoveKind kind;
+    uint8_t density;        // falling cells sink through lighter liquids
+    uint16_t gravity;       // velocity gained per frame, in VELOCITY_SCALE steps
+    uint16_t maxVelocity;   // in VELOCITY_SCALE steps
+    uint16_t slideVelocity; // velocity after sliding down a diagonal
+    uint8_t dispersion;     // cells a liquid can run sideways per frame
+    bool flammable;         // catches fire next to fire
+    int8_t heat;            // added to its heat sample each frame, negative cools
+    uint16_t ignition;      // sample heat that can set it alight without touching fire, 0 never
+    uint8_t color[4];       // RGBA, fire flickers around this in the renderer
+};
+
+// Indexed by PixelType
+constexpr MaterialTraits MATERIALS[MATERIAL_COUNT] = {
+    {"Empty", MoveKind::STATIC, 0,       0,       0,      0,     0,    false,     0,    0,     {0, 0, 0, 0}},
+    {"Sand",  MoveKind::POWDER, 3,       20,      1000,   200,   0,    false,     0,    0,     {200, 180, 50, 255}},
+    {"Water", MoveKind::LIQUID, 2,       10,      600,    100,   6,    false,     -8,   0,     {50, 100, 220, 255}},
+    {"Stone", MoveKind::STATIC, 255,     0,       0,      0,     0,    false,     0,    0,     {120, 120, 120, 255}},
+    {"Fire",  MoveKind::FIRE,   0,       0,       0,      0,     0,    false,     8,    0,     {255, 80, 20, 255}},
+    {"Oil",   MoveKind::LIQUID, 1,       8,       500,    100,   4,    true,      0,    600,   {30, 30, 30, 255}},
+};
+
+constexpr const MaterialTraits &materialTraits(PixelType type)
+{
+    return MATERIALS[static_cast<int>(type)];
+}
+
+constexpr bool isFalling(PixelType type)
+{
+    return materialTraits(type).kind == MoveKind::POWDER || materialTraits(type).kind == MoveKind::LIQUID;
+}
+
+// Falling cells swap with empty space and with lighter liquids
+struct DisplacementTable
+{
+    bool canDisplace[MATERIAL_COUNT][MATERIAL_COUNT];
+};
+
+constexpr DisplacementTable makeDisplacementTable()
+{
+    DisplacementTable table{};
+    for (int mover = 0; mover < MATERIAL_COUNT; mover++)
+    {
+        for (int target = 0; target < MATERIAL_COUNT; target++)
+        {
+            const MaterialTraits &t = MATERIALS[target];
+            table.canDisplace[mover][target] =
+                target == static_cast<int>(PixelType::EMPTY) ||
+                (isFalling(static_cast<PixelType>(mover)) && t.kind == MoveKind::LIQUID &&
+                 t.density < MATERIALS[mover].density);
+        }
+    }
+    return table;
+}
+
+constexpr DisplacementTable DISPLACEMENT = makeDisplacementTable();
+
+// Furthest any material falls in one frame, in cells
+constexpr int maxFallDistance()
+{
+    int cells = 0;
+    for (const MaterialTraits &m : MATERIALS)
+    {
+        if (m.maxVelocity / VELOCITY_SCALE > cells)
+            cells = m.maxVelocity / VELOCITY_SCALE;
+    }
+    return cells;
+}
+
+// Furthest any cell moves in one frame, falling or running sideways, in cells
+constexpr int maxMoveDistance()
+{
+    int cells = maxFallDistance();
+    for (const MaterialTraits &m : MATERIALS)
+    {
+        if (m.dispersion > cells)
+            cells = m.dispersion;
+    }
+    return cells;
+}
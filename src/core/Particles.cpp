@@ -0,0 +1,97 @@
+#include "Particles.hpp"
+#include <algorithm>
+
+static int32_t toSubcells(int velocity)
+{
+    int32_t v = velocity * ParticleLayer::SUBCELL / VELOCITY_SCALE;
+    return std::clamp(v, -ParticleLayer::MAX_SPEED, ParticleLayer::MAX_SPEED);
+}
+
+void ParticleLayer::add(int x, int y, int velocityX, int velocityY, PixelType type, uint16_t value)
+{
+    int gravity = materialTraits(type).gravity;
+    m_x.push_back(x * SUBCELL + SUBCELL / 2);
+    m_y.push_back(y * SUBCELL + SUBCELL / 2);
+    m_vx.push_back(toSubcells(velocityX));
+    m_vy.push_back(toSubcells(velocityY));
+    m_gravity.push_back(toSubcells(gravity > 0 ? gravity : DEFAULT_GRAVITY));
+    m_fromX.push_back(x);
+    m_fromY.push_back(y);
+    m_type.push_back(type);
+    m_value.push_back(value);
+}
+
+void ParticleLayer::remove(int i)
+{
+    auto pop = [i](auto &field)
+    {
+        field[i] = field.back();
+        field.pop_back();
+    };
+    pop(m_x);
+    pop(m_y);
+    pop(m_vx);
+    pop(m_vy);
+    pop(m_gravity);
+    pop(m_fromX);
+    pop(m_fromY);
+    pop(m_type);
+    pop(m_value);
+}
+
+void ParticleLayer::clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_vx.clear();
+    m_vy.clear();
+    m_gravity.clear();
+    m_fromX.clear();
+    m_fromY.clear();
+    m_type.clear();
+    m_value.clear();
+}
+
+void ParticleLayer::shift(int dx, int dy)
+{
+    for (int i = 0; i < size(); i++)
+    {
+        m_x[i] += dx * SUBCELL;
+        m_y[i] += dy * SUBCELL;
+        m_fromX[i] += dx;
+        m_fromY[i] += dy;
+    }
+}
+
+void ParticleLayer::integrate()
+{
+    // Plain integer loops over the arrays, which the compiler vectorises
+    const int n = size();
+    int32_t *x = m_x.data(), *y = m_y.data(), *vx = m_vx.data(), *vy = m_vy.data();
+    int32_t *fromX = m_fromX.data(), *fromY = m_fromY.data();
+    const int32_t *gravity = m_gravity.data();
+    for (int i = 0; i < n; i++)
+    {
+        fromX[i] = x[i] >> SUBCELL_BITS;
+        fromY[i] = y[i] >> SUBCELL_BITS;
+        vy[i] = std::min(vy[i] + gravity[i], MAX_SPEED);
+        vx[i] -= vx[i] >> 5;
+        x[i] += vx[i];
+        y[i] += vy[i];
+    }
+}
+
+void ParticleLayer::place(int i, int x, int y, int velocityX, int velocityY)
+{
+    m_x[i] = x * SUBCELL + SUBCELL / 2;
+    m_y[i] = y * SUBCELL + SUBCELL / 2;
+    m_vx[i] = toSubcells(velocityX);
+    m_vy[i] = toSubcells(velocityY);
+}
+
+void ParticleLayer::sprites(std::vector<ParticleSprite> &out) const
+{
+    out.resize(m_type.size());
+    for (int i = 0; i < size(); i++)
+        out[i] = {cellX(i), cellY(i), m_type[i]};
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "Materials.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Where a particle is drawn, in grid cells
+struct ParticleSprite
+{
+    int x, y;
+    PixelType type;
+};
+
+// A falling cell leaving the grid, queued on its chunk until the particle pass takes it
+struct ParticleLaunch
+{
+    int x, y;
+    int velocityY; // in VELOCITY_SCALE steps
+    PixelType type;
+};
+
+// Cells in free flight off the grid, one array per field. Positions and velocities are fixed
+// point in 1/SUBCELL cells, so flights replay bit-identically on every build. Velocities are
+// per frame like the grid's, and cross the API in VELOCITY_SCALE steps.
+class ParticleLayer
+{
+public:
+    static constexpr int SUBCELL_BITS = 8;
+    static constexpr int SUBCELL = 1 << SUBCELL_BITS;
+    static constexpr int MAX_SPEED = 16 * SUBCELL; // per axis per frame, so a frame's path stays short
+    // Gravity for materials that never fall on the grid, in VELOCITY_SCALE steps per frame
+    static constexpr int DEFAULT_GRAVITY = 20;
+
+    // Launches a particle from the centre of cell x,y
+    void add(int x, int y, int velocityX, int velocityY, PixelType type, uint16_t value);
+    // Drops particle i, the last one takes its place
+    void remove(int i);
+    void clear();
+    // Moves every particle by dx,dy cells, as when the grid's origin moves
+    void shift(int dx, int dy);
+
+    // One frame of flight for every particle: gravity, a little air drag, then the move. The
+    // cell each one left is kept for the collision pass to walk from.
+    void integrate();
+
+    // Puts particle i back in cell x,y with the given velocity, in VELOCITY_SCALE steps
+    void place(int i, int x, int y, int velocityX, int velocityY);
+
+    int size() const { return static_cast<int>(m_type.size()); }
+    bool empty() const { return m_type.empty(); }
+
+    int cellX(int i) const { return m_x[i] >> SUBCELL_BITS; }
+    int cellY(int i) const { return m_y[i] >> SUBCELL_BITS; }
+    int fromX(int i) const { return m_fromX[i]; }
+    int fromY(int i) const { return m_fromY[i]; }
+    int velocityX(int i) const { return m_vx[i] * VELOCITY_SCALE / SUBCELL; }
+    int velocityY(int i) const { return m_vy[i] * VELOCITY_SCALE / SUBCELL; }
+    // Larger of the two velocity components, in cells per frame
+    int speed(int i) const { return std::max(std::abs(m_vx[i]), std::abs(m_vy[i])) >> SUBCELL_BITS; }
+    PixelType type(int i) const { return m_type[i]; }
+    uint16_t value(int i) const { return m_value[i]; }
+
+    void sprites(std::vector<ParticleSprite> &out) const;
+
+private:
+    std::vector<int32_t> m_x, m_y;         // position in subcells
+    std::vector<int32_t> m_vx, m_vy;       // velocity in subcells per frame
+    std::vector<int32_t> m_gravity;        // subcells per frame per frame
+    std::vector<int32_t> m_fromX, m_fromY; // cell before the last integrate()
+    std::vector<PixelType> m_type;
+    std::vector<uint16_t> m_value; // fire lifetime, kept for landing
+};
@@ -1,359 +1,1551 @@
 #include "PixelWorld.hpp"
+#include "Profiler.hpp"
+#include "RowMask.hpp"
 #include <algorithm>
-#include <raylib.h>
+#include <bit>
+#include <chrono>
+#include <cmath>
 
-PixelWorld::PixelWorld(int width, int height)
-    : m_width(width), m_height(height), m_pixels(width * height) {}
+// Fire heats samples up to FLAME_HEAT and goes out in one cooled below QUENCH_HEAT; water
+// holds samples down to COLDEST_HEAT
+static const int FLAME_HEAT = 1000;
+static const int QUENCH_HEAT = -16;
+static const int COLDEST_HEAT = -64;
+// A flammable cell in a sample past its ignition heat lights with 1 in this chance per frame
+static const int HEAT_IGNITION_ODDS = 32;
+// Cells per frame a particle must hit a liquid at to throw some of it up
+static const int SPLASH_SPEED = 3;
+// Surface cells either side of an impact a splash can throw
+static const int SPLASH_REACH = 2;
+// Blasts throw cells at their centre this fast, in cells per frame, tapering to half at the
+// edge, plus a lift so most of the debris arcs up first
+static const int BLAST_SPEED = 8;
+static const int BLAST_LIFT = 2;
+
+// Chunks either side of the focus that run on every budgeted update
+static const int FOCUS_CHUNKS = 2;
+
+static_assert(PixelWorld::CHUNK_SIZE % HeatField::SAMPLE == 0, "heat samples never straddle chunks");
+
+// 2 to 4 seconds
+static uint16_t randomFireLifetime(Random &rng)
+{
+    return static_cast<uint16_t>(2 * LIFETIME_SCALE + rng.range(0, 1000) * 2 * LIFETIME_SCALE / 1000);
+}
+
+PixelWorld::PixelWorld(int width, int height, uint64_t seed)
+    : m_width(width), m_height(height),
+      m_types(width * height, PixelType::EMPTY), m_updated(width * height, 0), m_values(width * height, 0),
+      m_heat(width, height),
+      m_bitplanes(width),
+      m_chunksX((width + CHUNK_SIZE - 1) / CHUNK_SIZE),
+      m_chunksY((height + CHUNK_SIZE - 1) / CHUNK_SIZE),
+      m_chunks(m_chunksX * m_chunksY),
+      m_pool(std::make_unique<ThreadPool>(1)),
+      m_chunkLocks(std::make_unique<std::mutex[]>(m_chunks.size()))
+{
+    m_bitplaneAwake.resize(m_chunksX);
+    m_bitplaneRandom.resize(m_chunksX);
+    m_bitplaneChanged.resize(m_chunksX);
+    this->seed(seed);
+}
+
+void PixelWorld::copyFrame(WorldFrame &frame) const
+{
+    frame.width = m_width;
+    frame.height = m_height;
+    frame.types = m_types;
+    frame.values = m_values;
+}
+
+void PixelWorld::loadFrame(const WorldFrame &frame)
+{
+    clear();
+
+    int w = std::min(frame.width, m_width);
+    int h = std::min(frame.height, m_height);
+    for (int y = 0; y < h; y++)
+    {
+        std::copy_n(&frame.types[y * frame.width], w, &m_types[idx(0, y)]);
+        std::copy_n(&frame.values[y * frame.width], w, &m_values[idx(0, y)]);
+    }
+
+    // Nothing is known to be settled, so everything gets one look
+    wakeRegion(0, 0, m_width - 1, m_height - 1);
+    listFires(0, 0, m_width - 1, m_height - 1);
+}
+
+void PixelWorld::moveOrigin(int originX, int originY)
+{
+    const int dx = originX - m_originX, dy = originY - m_originY;
+    if (dx == 0 && dy == 0)
+        return;
+    m_originX = originX;
+    m_originY = originY;
+
+    // Cell x,y of the new grid was cell x+dx,y+dy of the old one
+    std::vector<PixelType> types(m_types.size(), PixelType::EMPTY);
+    std::vector<uint16_t> values(m_values.size(), 0);
+    int x0 = std::max(-dx, 0), x1 = std::min(m_width - dx, m_width);
+    for (int y = std::max(-dy, 0); y < std::min(m_height - dy, m_height) && x0 < x1; y++)
+    {
+        std::copy_n(&m_types[idx(x0 + dx, y + dy)], x1 - x0, &types[idx(x0, y)]);
+        std::copy_n(&m_values[idx(x0 + dx, y + dy)], x1 - x0, &values[idx(x0, y)]);
+    }
+    m_types.swap(types);
+    m_values.swap(values);
+    std::fill(m_updated.begin(), m_updated.end(), 0);
+    m_heat.shift(dx / HeatField::SAMPLE, dy / HeatField::SAMPLE);
+
+    // Particles fly on with their cells, those left beside or below the grid are gone
+    m_particles.shift(-dx, -dy);
+    for (int i = 0; i < m_particles.size();)
+    {
+        int x = m_particles.cellX(i), y = m_particles.cellY(i);
+        if (x < 0 || x >= m_width || y >= m_height)
+            m_particles.remove(i);
+        else
+            i++;
+    }
+
+    // Wakes move with their cells; each chunk keeps its random stream so seeded runs stay put
+    std::vector<DirtyRect> next(m_chunks.size());
+    const int dcx = dx / CHUNK_SIZE, dcy = dy / CHUNK_SIZE;
+    for (int cy = 0; cy < m_chunksY; cy++)
+    {
+        for (int cx = 0; cx < m_chunksX; cx++)
+        {
+            int sx = cx + dcx, sy = cy + dcy;
+            if (sx < 0 || sy < 0 || sx >= m_chunksX || sy >= m_chunksY)
+                continue;
+            const DirtyRect &r = m_chunks[sy * m_chunksX + sx].next;
+            if (r.empty())
+                continue;
+            // Edge chunks can be partial, so a full chunk moving there gets clipped
+            int minX = r.minX - dx, maxX = std::min(r.maxX - dx, m_width - 1);
+            int minY = r.minY - dy, maxY = std::min(r.maxY - dy, m_height - 1);
+            if (minX <= maxX && minY <= maxY)
+                next[cy * m_chunksX + cx].include(minX, minY, maxX, maxY);
+        }
+    }
+
+    // Every cell on screen shifted, so all of it has to be redrawn
+    for (int cy = 0; cy < m_chunksY; cy++)
+    {
+        for (int cx = 0; cx < m_chunksX; cx++)
+        {
+            Chunk &chunk = m_chunks[cy * m_chunksX + cx];
+            chunk.current.reset();
+            chunk.next = next[cy * m_chunksX + cx];
+            chunk.fires.clear();
+            chunk.changed.include(cx * CHUNK_SIZE, cy * CHUNK_SIZE,
+                                  std::min((cx + 1) * CHUNK_SIZE, m_width) - 1,
+                                  std::min((cy + 1) * CHUNK_SIZE, m_height) - 1);
+        }
+    }
+    listFires(0, 0, m_width - 1, m_height - 1);
+}
+
+void PixelWorld::copyChunk(int cx, int cy, ChunkCells &cells) const
+{
+    cells.clear();
+    int x0 = cx * CHUNK_SIZE, y0 = cy * CHUNK_SIZE;
+    int w = std::min(CHUNK_SIZE, m_width - x0);
+    for (int row = 0; row < std::min(CHUNK_SIZE, m_height - y0) && w > 0; row++)
+    {
+        std::copy_n(&m_types[idx(x0, y0 + row)], w, &cells.types[row * CHUNK_SIZE]);
+        std::copy_n(&m_values[idx(x0, y0 + row)], w, &cells.values[row * CHUNK_SIZE]);
+    }
+}
+
+void PixelWorld::loadChunk(int cx, int cy, const ChunkCells &cells)
+{
+    int x0 = cx * CHUNK_SIZE, y0 = cy * CHUNK_SIZE;
+    int w = std::min(CHUNK_SIZE, m_width - x0);
+    int h = std::min(CHUNK_SIZE, m_height - y0);
+    if (w <= 0 || h <= 0)
+        return;
+    for (int row = 0; row < h; row++)
+    {
+        std::copy_n(&cells.types[row * CHUNK_SIZE], w, &m_types[idx(x0, y0 + row)]);
+        std::copy_n(&cells.values[row * CHUNK_SIZE], w, &m_values[idx(x0, y0 + row)]);
+    }
+
+    // Nothing is known to be settled, and the neighbours may have been resting against the edge
+    wakeRegion(x0 - 1, y0 - 1, x0 + w, y0 + h);
+    listFires(x0, y0, x0 + w - 1, y0 + h - 1);
+}
+
+void PixelWorld::seed(uint64_t seed)
+{
+    m_random.reseed(seed);
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        m_chunks[i].random.reseed(seed + (i + 1) * 0x632BE59BD9B4E019ull);
+    }
+}
+
+void PixelWorld::setThreadCount(int count)
+{
+    count = std::max(count, 1);
+    if (count != m_pool->threadCount())
+        m_pool = std::make_unique<ThreadPool>(count);
+}
 
 void PixelWorld::clear()
 {
-    std::fill(m_pixels.begin(), m_pixels.end(), Pixel{});
+    std::fill(m_types.begin(), m_types.end(), PixelType::EMPTY);
+    std::fill(m_updated.begin(), m_updated.end(), 0);
+    std::fill(m_values.begin(), m_values.end(), 0);
+    m_heat.clear();
+    m_particles.clear();
+
+    // An empty world has nothing left to simulate, but all of it has to be redrawn
+    for (int cy = 0; cy < m_chunksY; cy++)
+    {
+        for (int cx = 0; cx < m_chunksX; cx++)
+        {
+            Chunk &chunk = m_chunks[cy * m_chunksX + cx];
+            chunk.current.reset();
+            chunk.next.reset();
+            chunk.fires.clear();
+            chunk.launched.clear();
+            chunk.changed.include(cx * CHUNK_SIZE, cy * CHUNK_SIZE,
+                                  std::min((cx + 1) * CHUNK_SIZE, m_width) - 1,
+                                  std::min((cy + 1) * CHUNK_SIZE, m_height) - 1);
+        }
+    }
+    m_activeChunks = 0;
 }
 
 void PixelWorld::addPixel(int x, int y, PixelType type)
 {
     if (x < 0 || y < 0 || x >= m_width || y >= m_height)
         return;
-    Pixel &p = m_pixels[idx(x, y)];
-    p.type = type;
+    int i = idx(x, y);
+    m_types[i] = type;
     if (type == PixelType::FIRE)
     {
-        p.lifetime = 2.0f + GetRandomValue(0, 1000) / 1000.0f * 2.0f;
+        m_values[i] = randomFireLifetime(m_random);
+        listFire(i);
+    }
+    else
+    {
+        m_values[i] = 0;
     }
+    wakeCell(x, y);
 }
 
-void PixelWorld::update(float dt)
+void PixelWorld::queueEdits(const EditBuffer &edits)
 {
-    // Reset updated flags
-    for (auto &pixel : m_pixels)
+    std::lock_guard<std::mutex> lock(m_editMutex);
+    m_queuedEdits.append(edits);
+}
+
+bool PixelWorld::paintSpan(int y, int x0, int x1, PixelType type, uint8_t density)
+{
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, m_width - 1);
+    if (y < 0 || y >= m_height || x0 > x1)
+        return false;
+
+    int i = idx(x0, y);
+    int count = x1 - x0 + 1;
+    if (density == EDIT_SOLID && type != PixelType::FIRE)
     {
-        pixel.updated = false;
+        std::fill_n(&m_types[i], count, type);
+        std::fill_n(&m_values[i], count, 0);
+        return true;
     }
 
-    // bottom-up: sand & water & oil (process heaviest first so they sink properly)
-    for (int y = m_height - 2; y >= 0; y--)
+    for (int k = i; k < i + count; k++)
     {
-        for (int x = 0; x < m_width; x++)
+        if (density != EDIT_SOLID && m_random.range(0, EDIT_SOLID - 1) >= density)
+            continue;
+        m_types[k] = type;
+        m_values[k] = 0;
+        if (type == PixelType::FIRE)
         {
-            Pixel &p = m_pixels[idx(x, y)];
-            if (p.updated)
-                continue;
-
-            // Process sand first (heaviest - sinks through everything)
-            if (p.type == PixelType::SAND)
-                updateSand(x, y);
+            m_values[k] = randomFireLifetime(m_random);
+            listFire(k);
         }
+    }
+    return true;
+}
+
+void PixelWorld::floodFill(const EditCommand &command, DirtyRect &bounds)
+{
+    if (command.x0 < 0 || command.y0 < 0 || command.x0 >= m_width || command.y0 >= m_height)
+        return;
+    PixelType target = m_types[idx(command.x0, command.y0)];
+    if (target == command.type)
+        return;
+
+    // Scanline fill: paint the whole run around each seed, then seed the runs above and below it
+    m_floodStack.clear();
+    m_floodStack.push_back({command.x0, command.y0});
+    while (!m_floodStack.empty())
+    {
+        auto [x, y] = m_floodStack.back();
+        m_floodStack.pop_back();
+        if (m_types[idx(x, y)] != target)
+            continue;
+
+        int left = x, right = x;
+        while (left > 0 && m_types[idx(left - 1, y)] == target)
+            left--;
+        while (right < m_width - 1 && m_types[idx(right + 1, y)] == target)
+            right++;
+        paintSpan(y, left, right, command.type, EDIT_SOLID);
+        bounds.include(left, y, right, y);
 
-        // Second pass for water (heavier than oil - sinks through oil)
-        for (int x = 0; x < m_width; x++)
+        for (int ny : {y - 1, y + 1})
         {
-            Pixel &p = m_pixels[idx(x, y)];
-            if (p.updated)
+            if (ny < 0 || ny >= m_height)
                 continue;
-
-            if (p.type == PixelType::WATER)
-                updateWater(x, y);
+            for (int nx = left; nx <= right; nx++)
+            {
+                if (m_types[idx(nx, ny)] == target && (nx == left || m_types[idx(nx - 1, ny)] != target))
+                    m_floodStack.push_back({nx, ny});
+            }
         }
+    }
+}
+
+void PixelWorld::applyEdits(const EditBuffer &edits)
+{
+    for (EditCommand command : edits.commands())
+    {
+        command.x0 -= m_originX;
+        command.x1 -= m_originX;
+        command.y0 -= m_originY;
+        command.y1 -= m_originY;
 
-        // Third pass for oil (lightest liquid - floats on water)
-        for (int x = 0; x < m_width; x++)
+        DirtyRect bounds;
+        auto span = [&](int y, int x0, int x1, PixelType type)
         {
-            Pixel &p = m_pixels[idx(x, y)];
-            if (p.updated)
-                continue;
+            if (paintSpan(y, x0, x1, type, command.density))
+                bounds.include(std::max(x0, 0), y, std::min(x1, m_width - 1), y);
+        };
+
+        switch (command.shape)
+        {
+        case EditShape::RECT:
+        {
+            int y0 = std::min(command.y0, command.y1), y1 = std::max(command.y0, command.y1);
+            int x0 = std::min(command.x0, command.x1), x1 = std::max(command.x0, command.x1);
+            for (int y = std::max(y0, 0); y <= std::min(y1, m_height - 1); y++)
+                span(y, x0, x1, command.type);
+            break;
+        }
+        case EditShape::CIRCLE:
+        case EditShape::LINE:
+        {
+            // Each row crosses the round-ended stroke in one interval: the union of the two end
+            // caps and the band along the segment, where 0 <= t <= 1 and |distance| <= radius
+            int r = std::max(command.radius, 0);
+            double ax = command.x0, ay = command.y0;
+            double dx = command.x1 - command.x0, dy = command.y1 - command.y0;
+            double lengthSq = dx * dx + dy * dy;
+            double reach = r * std::sqrt(lengthSq);
+
+            int yMin = std::max(std::min(command.y0, command.y1) - r, 0);
+            int yMax = std::min(std::max(command.y0, command.y1) + r, m_height - 1);
+            for (int y = yMin; y <= yMax; y++)
+            {
+                double lo = 1e30, hi = -1e30;
+                for (int end = 0; end < 2; end++)
+                {
+                    int cx = end ? command.x1 : command.x0;
+                    int cy = end ? command.y1 : command.y0;
+                    int rem = r * r - (y - cy) * (y - cy);
+                    if (rem < 0)
+                        continue;
+                    int half = static_cast<int>(std::sqrt(static_cast<double>(rem)));
+                    lo = std::min(lo, static_cast<double>(cx - half));
+                    hi = std::max(hi, static_cast<double>(cx + half));
+                }
+
+                if (lengthSq > 0.0)
+                {
+                    // Both conditions are linear in x: a * x + b within [min, max]
+                    double bandLo = -1e30, bandHi = 1e30;
+                    auto clampTo = [&](double a, double b, double min, double max)
+                    {
+                        if (a == 0.0)
+                        {
+                            if (b < min || b > max)
+                                bandLo = 1e30;
+                            return;
+                        }
+                        double x0 = (min - b) / a, x1 = (max - b) / a;
+                        bandLo = std::max(bandLo, std::min(x0, x1));
+                        bandHi = std::min(bandHi, std::max(x0, x1));
+                    };
+                    double ry = y - ay;
+                    clampTo(dx, -ax * dx + ry * dy, 0.0, lengthSq);
+                    clampTo(dy, -ax * dy - ry * dx, -reach, reach);
+                    if (bandLo <= bandHi)
+                    {
+                        lo = std::min(lo, std::ceil(bandLo));
+                        hi = std::max(hi, std::floor(bandHi));
+                    }
+                }
 
-            if (p.type == PixelType::OIL)
-                updateOil(x, y);
+                lo = std::max(lo, -1.0);
+                hi = std::min(hi, static_cast<double>(m_width));
+                if (lo <= hi)
+                    span(y, static_cast<int>(lo), static_cast<int>(hi), command.type);
+            }
+            break;
+        }
+        case EditShape::FLOOD:
+            floodFill(command, bounds);
+            break;
+        case EditShape::BLAST:
+            blast(command, bounds);
+            break;
+        case EditShape::MASK:
+        {
+            int width = command.x1 - command.x0 + 1;
+            for (int row = 0; row <= command.y1 - command.y0; row++)
+            {
+                const uint8_t *cells = &edits.masks()[command.mask + row * width];
+                int y = command.y0 + row;
+                for (int start = 0; start < width;)
+                {
+                    // Runs of one material go down as a single span
+                    int end = start + 1;
+                    while (end < width && cells[end] == cells[start])
+                        end++;
+                    if (cells[start] < MATERIAL_COUNT)
+                        span(y, command.x0 + start, command.x0 + end - 1, static_cast<PixelType>(cells[start]));
+                    start = end;
+                }
+            }
+            break;
+        }
         }
+
+        if (!bounds.empty())
+            wakeRegion(bounds.minX - 1, bounds.minY - 1, bounds.maxX + 1, bounds.maxY + 1);
     }
+}
 
-    // top-down: fire
-    for (int y = 1; y < m_height; y++)
+void PixelWorld::wakeRegion(int x0, int y0, int x1, int y1)
+{
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, m_width - 1);
+    y1 = std::min(y1, m_height - 1);
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // Split the region over every chunk it touches
+    for (int cy = y0 / CHUNK_SIZE; cy <= y1 / CHUNK_SIZE; cy++)
     {
-        for (int x = 0; x < m_width; x++)
+        int chunkMinY = cy * CHUNK_SIZE;
+        int chunkMaxY = chunkMinY + CHUNK_SIZE - 1;
+        for (int cx = x0 / CHUNK_SIZE; cx <= x1 / CHUNK_SIZE; cx++)
         {
-            Pixel &p = m_pixels[idx(x, y)];
-            if (p.type == PixelType::FIRE && !p.updated)
+            int chunkMinX = cx * CHUNK_SIZE;
+            int chunkMaxX = chunkMinX + CHUNK_SIZE - 1;
+            int i = cy * m_chunksX + cx;
+            if (m_concurrentWakes)
             {
-                updateFire(x, y, dt);
-                p.updated = true;
+                std::lock_guard<std::mutex> lock(m_chunkLocks[i]);
+                m_chunks[i].next.include(std::max(x0, chunkMinX), std::max(y0, chunkMinY),
+                                         std::min(x1, chunkMaxX), std::min(y1, chunkMaxY));
+            }
+            else
+            {
+                m_chunks[i].next.include(std::max(x0, chunkMinX), std::max(y0, chunkMinY),
+                                         std::min(x1, chunkMaxX), std::min(y1, chunkMaxY));
             }
         }
     }
 }
 
-void PixelWorld::updateSand(int x, int y)
+void PixelWorld::listFire(int i)
+{
+    int c = (i / m_width / CHUNK_SIZE) * m_chunksX + (i % m_width) / CHUNK_SIZE;
+    if (m_concurrentWakes)
+    {
+        std::lock_guard<std::mutex> lock(m_chunkLocks[c]);
+        m_chunks[c].fires.push_back(i);
+    }
+    else
+    {
+        m_chunks[c].fires.push_back(i);
+    }
+}
+
+void PixelWorld::listFires(int x0, int y0, int x1, int y1)
+{
+    for (int y = std::max(y0, 0); y <= std::min(y1, m_height - 1); y++)
+    {
+        for (int x = std::max(x0, 0); x <= std::min(x1, m_width - 1); x++)
+        {
+            if (m_types[idx(x, y)] == PixelType::FIRE)
+                listFire(idx(x, y));
+        }
+    }
+}
+
+// Moves the cell at (x0, y0) to (x1, y1) and whatever was there back to (x0, y0)
+void PixelWorld::swapCells(int x0, int y0, int x1, int y1)
+{
+    int a = idx(x0, y0);
+    int b = idx(x1, y1);
+    std::swap(m_types[a], m_types[b]);
+    std::swap(m_values[a], m_values[b]);
+    m_updated[a] = m_updated[b];
+    PROFILE_COUNT(SWAPS, 1);
+    PROFILE_COUNT(CELLS_MOVED, m_types[a] == PixelType::EMPTY ? 1 : 2);
+
+    // The moved cell is done for this frame, even if a later row or chunk reaches it again
+    m_updated[b] = 1;
+    wakeCell(x0, y0);
+    wakeCell(x1, y1);
+}
+
+void PixelWorld::update(float dt)
 {
-    static const float GRAVITY = 0.1f;
-    static const float MAX_VELOCITY = 5.0f;
+    PROFILE_SCOPE("world.update");
 
-    Pixel &cell = m_pixels[idx(x, y)];
-    if (cell.updated)
+    // Edits queued from other threads land before anything moves
+    {
+        std::lock_guard<std::mutex> lock(m_editMutex);
+        std::swap(m_applyingEdits, m_queuedEdits);
+    }
+    if (!m_applyingEdits.empty())
+    {
+        PROFILE_SCOPE("world.edits");
+        applyEdits(m_applyingEdits);
+        m_applyingEdits.clear();
+    }
+
+    // Promote the cells woken last frame; everything else stays asleep
+    for (Chunk &chunk : m_chunks)
+    {
+        chunk.current = chunk.next;
+        chunk.next.reset();
+    }
+    scheduleChunks();
+
+    m_activeChunks = m_deferredChunks;
+    long cells = 0;
+    for (Chunk &chunk : m_chunks)
+    {
+        if (chunk.current.empty())
+            continue;
+
+        m_activeChunks++;
+        const DirtyRect &r = chunk.current;
+        cells += static_cast<long>(r.maxX - r.minX + 1) * (r.maxY - r.minY + 1);
+        // Blocks never overlap within a frame, so they need no flags
+        if (m_updateMode == UpdateMode::MARGOLUS)
+            continue;
+        for (int y = r.minY; y <= r.maxY; y++)
+        {
+            std::fill_n(&m_updated[idx(r.minX, y)], r.maxX - r.minX + 1, 0);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (m_updateMode == UpdateMode::CHECKERBOARD)
+        updateCheckerboard(dt);
+    else if (m_updateMode == UpdateMode::MARGOLUS)
+        updateMargolus(dt);
+    else
+        updateSerial(dt);
+    // Less than a chunk's worth is mostly fixed costs, which says little about a cell's
+    if (m_budgetMs > 0.0f && cells >= ChunkCells::CELLS)
+    {
+        float ns = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - start).count();
+        m_cellNs += 0.1f * (ns / cells - m_cellNs);
+    }
+    updateParticles();
+    if (m_levelling)
+        levelLiquids();
+    updateHeat();
+
+    // Edits woke cells into current, moves woke them into next
+    for (Chunk &chunk : m_chunks)
+    {
+        if (!chunk.current.empty())
+            chunk.changed.include(chunk.current.minX, chunk.current.minY, chunk.current.maxX, chunk.current.maxY);
+        if (!chunk.next.empty())
+            chunk.changed.include(chunk.next.minX, chunk.next.minY, chunk.next.maxX, chunk.next.maxY);
+    }
+}
+
+void PixelWorld::scheduleChunks()
+{
+    m_deferredChunks = 0;
+    m_maxDeferred = 0;
+    if (m_budgetMs <= 0.0f)
+    {
+        for (Chunk &chunk : m_chunks)
+            chunk.deferred = 0;
         return;
+    }
 
-    // Increase velocity due to gravity
-    cell.velocityY = std::min(cell.velocityY + GRAVITY, MAX_VELOCITY);
+    auto area = [](const DirtyRect &r) { return static_cast<long>(r.maxX - r.minX + 1) * (r.maxY - r.minY + 1); };
+    auto floorChunk = [](int cell) { return (cell >= 0 ? cell : cell - CHUNK_SIZE + 1) / CHUNK_SIZE; };
+    const int focusX = floorChunk(m_focusX - m_originX), focusY = floorChunk(m_focusY - m_originY);
+    auto nearFocus = [&](int i)
+    {
+        return std::abs(i % m_chunksX - focusX) <= FOCUS_CHUNKS && std::abs(i / m_chunksX - focusY) <= FOCUS_CHUNKS;
+    };
 
-    // Calculate target position based on velocity
-    int targetY = y + static_cast<int>(cell.velocityY);
-    targetY = std::min(targetY, m_height - 1);
+    // The focus always runs, over the budget or not
+    const long budget = static_cast<long>(m_budgetMs * 1e6f / m_cellNs);
+    const int count = chunkCount();
+    long cells = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Chunk &chunk = m_chunks[i];
+        if (!chunk.current.empty() && nearFocus(i))
+        {
+            cells += area(chunk.current);
+            chunk.deferred = 0;
+        }
+    }
 
-    // Find the first solid position below (sand can fall through liquids)
-    int newY = y + 1;
-    while (newY <= targetY && newY < m_height)
+    // The rest take turns: from the cursor on, chunks run until one would pass the budget,
+    // and that one goes first next time. One always runs, so every chunk gets its turn.
+    int stop = -1;
+    bool ranOne = false;
+    for (int k = 0; k < count; k++)
     {
-        PixelType belowType = m_pixels[idx(x, newY)].type;
-        if (belowType != PixelType::EMPTY &&
-            belowType != PixelType::WATER &&
-            belowType != PixelType::OIL)
+        int i = (m_budgetCursor + k) % count;
+        Chunk &chunk = m_chunks[i];
+        if (chunk.current.empty() || nearFocus(i))
+            continue;
+        if (stop < 0 && (!ranOne || cells + area(chunk.current) <= budget))
         {
-            break;
+            cells += area(chunk.current);
+            chunk.deferred = 0;
+            ranOne = true;
+            continue;
         }
-        newY++;
+
+        // Held back cells wake for the next update just as they are
+        if (stop < 0)
+            stop = i;
+        const DirtyRect &r = chunk.current;
+        chunk.next.include(r.minX, r.minY, r.maxX, r.maxY);
+        chunk.current.reset();
+        chunk.deferred++;
+        m_deferredChunks++;
+        m_maxDeferred = std::max(m_maxDeferred, chunk.deferred);
     }
-    newY--; // Step back to last valid position
+    if (stop >= 0)
+        m_budgetCursor = stop;
+}
 
-    if (newY > y)
+void PixelWorld::takeChangedRects(std::vector<DirtyRect> &rects)
+{
+    rects.clear();
+    for (Chunk &chunk : m_chunks)
     {
-        std::swap(cell, m_pixels[idx(x, newY)]);
+        if (chunk.changed.empty())
+            continue;
+        rects.push_back(chunk.changed);
+        chunk.changed.reset();
     }
-    else
+}
+
+void PixelWorld::updateSerial(float dt)
+{
+    // Visit the awake span of a row in each chunk, from left to right
+    auto forEachAwakeSpan = [this](int y, auto &&fn)
     {
-        // Try to move diagonally
-        int dir = GetRandomValue(0, 1) ? -1 : 1;
-        int nx = x + dir;
+        Chunk *row = &m_chunks[(y / CHUNK_SIZE) * m_chunksX];
+        for (int cx = 0; cx < m_chunksX; cx++)
+        {
+            const DirtyRect &r = row[cx].current;
+            if (!r.empty() && y >= r.minY && y <= r.maxY)
+                fn(r.minX, r.maxX, row[cx].random);
+        }
+    };
 
-        if (nx >= 0 && nx < m_width && y + 1 < m_height)
+    // bottom-up: every falling material in one pass per row
+    {
+        PROFILE_SCOPE("world.falling");
+        if (m_updateMode == UpdateMode::BITPLANE)
+        {
+            updateBitplanes();
+        }
+        else
         {
-            PixelType belowDiagType = m_pixels[idx(nx, y + 1)].type;
-            if (belowDiagType == PixelType::EMPTY ||
-                belowDiagType == PixelType::WATER ||
-                belowDiagType == PixelType::OIL)
+            for (int y = m_height - 2; y >= 0; y--)
             {
-                std::swap(cell, m_pixels[idx(nx, y + 1)]);
-                cell.velocityY = 1.0f;
+                forEachAwakeSpan(y, [&](int x0, int x1, Random &rng) { updateRow(y, x0, x1, rng); });
             }
-            else
+        }
+    }
+
+    // fire: only the cells on each chunk's list, no matter how much else is awake
+    {
+        PROFILE_SCOPE("world.fire");
+        for (Chunk &chunk : m_chunks)
+        {
+            if (!chunk.fires.empty() && chunk.deferred == 0)
+                updateFires(chunk, dt);
+        }
+    }
+}
+
+void PixelWorld::updateCheckerboard(float dt)
+{
+    // A cell reaches at most its fall or spread distance plus its wake radius past its chunk. Chunks of
+    // one phase are a whole chunk apart, so workers never touch the same cells.
+    static_assert(CHUNK_SIZE > 2 * (maxMoveDistance() + 1), "chunks too small for lock-free phases");
+
+    m_concurrentWakes = true;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        PROFILE_SCOPE(pass == 0 ? "world.falling" : "world.fire");
+        for (int phase = 0; phase < 4; phase++)
+        {
+            m_phaseChunks.clear();
+            for (int cy = phase / 2; cy < m_chunksY; cy += 2)
             {
-                cell.velocityY = 0;
+                for (int cx = phase % 2; cx < m_chunksX; cx += 2)
+                {
+                    const Chunk &chunk = m_chunks[cy * m_chunksX + cx];
+                    if (pass == 0 ? !chunk.current.empty() : !chunk.fires.empty() && chunk.deferred == 0)
+                        m_phaseChunks.push_back(cy * m_chunksX + cx);
+                }
             }
+
+            m_pool->parallelFor(static_cast<int>(m_phaseChunks.size()), [&](int i)
+            {
+                Chunk &chunk = m_chunks[m_phaseChunks[i]];
+                const DirtyRect &r = chunk.current;
+                if (pass == 0)
+                {
+                    for (int y = std::min(r.maxY, m_height - 2); y >= r.minY; y--)
+                        updateRow(y, r.minX, r.maxX, chunk.random);
+                }
+                else
+                {
+                    updateFires(chunk, dt);
+                }
+            });
         }
-        else
+    }
+    m_concurrentWakes = false;
+}
+
+void PixelWorld::updateMargolus(float dt)
+{
+    PROFILE_SCOPE("world.margolus");
+
+    // Fire lists hold where fires were; blocks list the ones that moved or lit, so drop what
+    // went out or moved on
+    for (Chunk &chunk : m_chunks)
+    {
+        if (chunk.fires.empty() || chunk.deferred > 0)
+            continue;
+        std::sort(chunk.fires.begin(), chunk.fires.end());
+        auto end = std::unique(chunk.fires.begin(), chunk.fires.end());
+        chunk.fires.erase(std::remove_if(chunk.fires.begin(), end, [this](int i) { return m_types[i] != PixelType::FIRE; }),
+                          chunk.fires.end());
+    }
+
+    // Both block offsets every frame, so each cell meets the blocks across all of its edges
+    // and a falling column moves a cell a frame. Fire burns down in the first pass only.
+    // A chunk row's blocks reach one cell into the row below, so rows of one phase are a
+    // whole chunk apart: they never share cells, heat samples or random streams.
+    m_concurrentWakes = true;
+    for (int offset = 0; offset < 2; offset++)
+    {
+        for (int phase = 0; phase < 2; phase++)
+        {
+            m_phaseChunks.clear();
+            for (int cy = phase; cy < m_chunksY; cy += 2)
+                m_phaseChunks.push_back(cy);
+            m_pool->parallelFor(static_cast<int>(m_phaseChunks.size()),
+                                [&](int i) { updateMargolusRows(m_phaseChunks[i], offset, offset == 0 ? dt : 0.0f); });
+        }
+    }
+    m_concurrentWakes = false;
+}
+
+void PixelWorld::updateMargolusRows(int cy, int offset, float dt)
+{
+    const MargolusRules &rules = margolusRules();
+    // With the grid offset the blocks along the edges hang off it, the top row of chunks
+    // takes the ones over the top edge
+    const int rowStart = cy * CHUNK_SIZE + offset - (cy == 0 && offset == 1 ? 2 : 0);
+    const int rowEnd = std::min((cy + 1) * CHUNK_SIZE, m_height);
+    for (int y = rowStart; y < rowEnd; y += 2)
+    {
+        // Blocks over the awake cells of either row. A block straddling two chunks is taken
+        // by the first that wants it.
+        const bool edgeRow = y < 0 || y + 1 >= m_height;
+        int doneX = -2;
+        for (int cx = 0; cx < m_chunksX; cx++)
+        {
+            int x0 = m_width, x1 = -1;
+            for (int row : {y, y + 1})
+            {
+                if (row < 0 || row >= m_height)
+                    continue;
+                const DirtyRect &r = m_chunks[(row / CHUNK_SIZE) * m_chunksX + cx].current;
+                if (!r.empty() && row >= r.minY && row <= r.maxY)
+                {
+                    x0 = std::min(x0, r.minX);
+                    x1 = std::max(x1, r.maxX);
+                }
+            }
+            x0 = std::max(x0 - ((x0 - offset) & 1), doneX + 1);
+            x1 -= (x1 - offset) & 1;
+            if (x0 > x1)
+                continue;
+            doneX = x1 + 1;
+
+            Random &rng = m_chunks[cy * m_chunksX + cx].random;
+            if (edgeRow)
+            {
+                for (int x = x0; x <= x1; x += 2)
+                    updateBlock(x, y, rules, rng, dt);
+                continue;
+            }
+
+            // Only blocks holding something that moves or burns can change
+            if (x0 < 0)
+            {
+                updateBlock(x0, y, rules, rng, dt);
+                x0 += 2;
+            }
+            int last = x1 + 1 >= m_width ? x1 - 2 : x1;
+            for (int px = x0; px <= last; px += 64)
+            {
+                int n = std::min(last + 2 - px, 64);
+                uint64_t live = classifyRow(&m_types[idx(px, y)], n, CLASS_FALLING | CLASS_FIRE) |
+                                classifyRow(&m_types[idx(px, y + 1)], n, CLASS_FALLING | CLASS_FIRE);
+                live = (live | live >> 1) & 0x5555555555555555ull;
+                while (live)
+                {
+                    int x = px + std::countr_zero(live);
+                    live &= live - 1;
+                    updateBlock(x, y, rules, rng, dt);
+                }
+            }
+            if (last != x1)
+                updateBlock(x1, y, rules, rng, dt);
+        }
+    }
+}
+
+void PixelWorld::updateBlock(int x, int y, const MargolusRules &rules, Random &rng, float dt)
+{
+    // Cells off the grid are -1 and hold like stone
+    int cells[4];
+    PixelType block[4];
+    for (int k = 0; k < 4; k++)
+    {
+        int cx = x + (k & 1), cy = y + (k >> 1);
+        cells[k] = cx >= 0 && cx < m_width && cy >= 0 && cy < m_height ? idx(cx, cy) : -1;
+        block[k] = cells[k] < 0 ? PixelType::STONE : m_types[cells[k]];
+
+        // Fire burns down before the block moves, what went out leaves an empty cell
+        if (block[k] == PixelType::FIRE && dt > 0.0f && !burn(cx, cy, dt, rng))
+            block[k] = PixelType::EMPTY;
+    }
+
+    int variant = (rng.bit() ? 1 : 0) | (rng.bit() ? 2 : 0);
+    int state = MargolusRules::state(block[0], block[1], block[2], block[3]);
+    uint16_t entry = rules.entries[variant][state];
+
+    // Velocities read as in the scalar kernels: a cell a frame while a cell drops, 0 once it
+    // stayed put through the first pass
+    if (dt > 0.0f)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            int i = cells[k];
+            if (i >= 0 && isFalling(block[k]) && m_values[i] != 0 && (entry == 0 || MargolusRules::source(entry, k) == k))
+                m_values[i] = 0;
+        }
+    }
+    if (entry == 0)
+    {
+        // Only one diagonal was tried, a block another variant drops a cell in stays awake
+        if (rules.drops[state])
+            wakeRegion(x, y, x + 1, y + 1);
+        return;
+    }
+
+    PixelType types[4];
+    uint16_t values[4];
+    for (int k = 0; k < 4; k++)
+    {
+        int from = cells[MargolusRules::source(entry, k)];
+        types[k] = from < 0 ? PixelType::STONE : m_types[from];
+        values[k] = from < 0 ? 0 : m_values[from];
+        if (int source = MargolusRules::source(entry, k); source != k && isFalling(types[k]))
+            values[k] = (k >> 1) > (source >> 1) ? VELOCITY_SCALE : 0;
+    }
+    for (int k = 0; k < 4; k++)
+    {
+        int i = cells[k];
+        if (i < 0)
+            continue;
+        m_types[i] = types[k];
+        m_values[i] = values[k];
+        if (MargolusRules::lights(entry, k))
+        {
+            m_types[i] = PixelType::FIRE;
+            m_values[i] = randomFireLifetime(rng);
+            listFire(i);
+            PROFILE_COUNT(FIRES_IGNITED, 1);
+        }
+        else if (types[k] == PixelType::FIRE && MargolusRules::source(entry, k) != k)
         {
-            cell.velocityY = 0;
+            listFire(i);
         }
     }
+    wakeRegion(x - 1, y - 1, x + 2, y + 2);
+}
 
-    cell.updated = true;
+template <size_t... I>
+constexpr std::array<PixelWorld::CellKernel, MATERIAL_COUNT> PixelWorld::makeKernels(std::index_sequence<I...>)
+{
+    return {(isFalling(static_cast<PixelType>(I)) ? &PixelWorld::updateFalling<static_cast<PixelType>(I)> : nullptr)...};
 }
 
-void PixelWorld::updateWater(int x, int y)
+void PixelWorld::updateRow(int y, int x0, int x1, Random &rng)
 {
-    static const float GRAVITY = 0.05f;
-    static const float MAX_VELOCITY = 3.0f;
+    // Kernel per material, null for anything that doesn't fall
+    static constexpr std::array<CellKernel, MATERIAL_COUNT> kernels = makeKernels(std::make_index_sequence<MATERIAL_COUNT>{});
 
-    Pixel &cell = m_pixels[idx(x, y)];
-    if (cell.updated)
+    if (!m_rowMasks)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            int i = idx(x, y);
+            CellKernel kernel = kernels[static_cast<int>(m_types[i])];
+            if (kernel && !m_updated[i])
+                (this->*kernel)(x, y, rng);
+        }
         return;
+    }
 
-    cell.velocityY = std::min(cell.velocityY + GRAVITY, MAX_VELOCITY);
+    static_assert(CHUNK_SIZE <= 64, "row masks hold one chunk row per word");
 
-    int targetY = y + static_cast<int>(cell.velocityY);
-    targetY = std::min(targetY, m_height - 1);
+    // Spans never cross a chunk, so one word covers the row; cells that move right
+    // during the pass land on bits that were clear, as the updated flag would have it
+    uint64_t mask = classifyRow(&m_types[idx(x0, y)], x1 - x0 + 1, CLASS_FALLING);
+    while (mask)
+    {
+        int x = x0 + std::countr_zero(mask);
+        mask &= mask - 1;
+        int i = idx(x, y);
+        CellKernel kernel = kernels[static_cast<int>(m_types[i])];
+        if (kernel && !m_updated[i])
+            (this->*kernel)(x, y, rng);
+    }
+}
 
-    // Water sinks through oil but stops at solids
-    int newY = y + 1;
-    while (newY <= targetY && newY < m_height)
+void PixelWorld::updateBitplanes()
+{
+    static_assert(CHUNK_SIZE == 64, "bitplane words hold one chunk row");
+
+    int lowerRow = -1; // row the bitplanes hold below the one being stepped
+    for (int y = m_height - 2; y >= 0; y--)
     {
-        PixelType belowType = m_pixels[idx(x, newY)].type;
-        if (belowType != PixelType::EMPTY && belowType != PixelType::OIL)
+        // Awake bits and random directions for each chunk's word of the row
+        Chunk *row = &m_chunks[(y / CHUNK_SIZE) * m_chunksX];
+        int first = m_chunksX, last = -1;
+        for (int cx = 0; cx < m_chunksX; cx++)
         {
-            break;
+            const DirtyRect &r = row[cx].current;
+            m_bitplaneAwake[cx] = 0;
+            if (r.empty() || y < r.minY || y > r.maxY)
+                continue;
+            int lo = r.minX - cx * CHUNK_SIZE, hi = r.maxX - cx * CHUNK_SIZE;
+            m_bitplaneAwake[cx] = (~0ull << lo) & (~0ull >> (63 - hi));
+            m_bitplaneRandom[cx] = static_cast<uint64_t>(row[cx].random.next()) << 32 | row[cx].random.next();
+            first = std::min(first, cx);
+            last = cx;
         }
-        newY++;
+        if (last < 0)
+            continue;
+
+        // Awake cells move at most one cell sideways, into the words either side
+        first = std::max(first - 1, 0);
+        last = std::min(last + 1, m_chunksX - 1);
+        m_bitplanes.load(&m_types[idx(0, y)], &m_types[idx(0, y + 1)], first, last, lowerRow == y + 1);
+        if (int moves = m_bitplanes.step(m_bitplaneAwake.data(), m_bitplaneRandom.data()); moves > 0)
+        {
+            PROFILE_COUNT(SWAPS, moves);
+            storeBitplaneRow(y + 1, first, last, true);
+            storeBitplaneRow(y, first, last, false);
+        }
+        for (int cx = first; cx <= last; cx++)
+        {
+            if (uint64_t retry = m_bitplanes.retry()[cx])
+                wakeRegion(cx * CHUNK_SIZE + std::countr_zero(retry), y, cx * CHUNK_SIZE + 63 - std::countl_zero(retry), y);
+        }
+        m_bitplanes.moveUp();
+        lowerRow = y;
     }
-    newY--;
+}
 
-    if (newY > y)
+void PixelWorld::storeBitplaneRow(int y, int first, int last, bool lower)
+{
+    PixelType *types = &m_types[idx(0, y)];
+    uint16_t *values = &m_values[idx(0, y)];
+    [[maybe_unused]] int moved = lower ? m_bitplanes.storeLower(types, values, m_bitplaneChanged.data())
+                                       : m_bitplanes.storeUpper(types, values, m_bitplaneChanged.data());
+    PROFILE_COUNT(CELLS_MOVED, moved);
+
+    for (int cx = first; cx <= last; cx++)
     {
-        std::swap(cell, m_pixels[idx(x, newY)]);
+        uint64_t changed = m_bitplaneChanged[cx];
+        if (changed)
+            wakeRegion(cx * CHUNK_SIZE + std::countr_zero(changed) - 1, y - 1,
+                       cx * CHUNK_SIZE + 63 - std::countl_zero(changed) + 1, y + 1);
     }
-    else
+}
+
+void PixelWorld::updateFires(Chunk &chunk, float dt)
+{
+    // Fires moving or spreading in from a neighbour get listed while this runs, so work
+    // through a taken copy. Cell order keeps seeded runs independent of listing order.
+    std::vector<int> &fires = chunk.firesTaken;
     {
-        // Try diagonal movement first
-        int dir = GetRandomValue(0, 1) ? -1 : 1;
-        int nx = x + dir;
+        std::unique_lock<std::mutex> lock(m_chunkLocks[&chunk - m_chunks.data()], std::defer_lock);
+        if (m_concurrentWakes)
+            lock.lock();
+        fires.swap(chunk.fires);
+    }
+    std::sort(fires.begin(), fires.end());
+    fires.erase(std::unique(fires.begin(), fires.end()), fires.end());
 
-        if (nx >= 0 && nx < m_width && y + 1 < m_height)
+    for (int i : fires)
+    {
+        if (m_types[i] != PixelType::FIRE)
+            continue; // burnt out, or replaced by an edit
+
+        // Moved or lit here earlier this frame, it burns on next frame
+        if (m_updated[i])
         {
-            PixelType belowDiagType = m_pixels[idx(nx, y + 1)].type;
-            if (belowDiagType == PixelType::EMPTY || belowDiagType == PixelType::OIL)
-            {
-                std::swap(cell, m_pixels[idx(nx, y + 1)]);
-                cell.velocityY = 0.5f;
-            }
-            else if (nx >= 0 && nx < m_width && m_pixels[idx(nx, y)].type == PixelType::EMPTY)
-            {
-                // Try horizontal movement
-                std::swap(cell, m_pixels[idx(nx, y)]);
-                cell.velocityY = 0;
-            }
-            else
+            listFire(i);
+            continue;
+        }
+
+        int burning = updateFire(i % m_width, i / m_width, dt, chunk.random);
+        m_updated[i] = 1;
+        if (burning >= 0)
+            listFire(burning);
+    }
+    fires.clear();
+}
+
+template <PixelType T>
+void PixelWorld::updateFalling(int x, int y, Random &rng)
+{
+    constexpr const MaterialTraits &M = materialTraits(T);
+    constexpr const bool *canDisplace = DISPLACEMENT.canDisplace[static_cast<int>(T)];
+
+    int i = idx(x, y);
+    if (m_updated[i])
+        return;
+
+    // A liquid resting on a denser liquid floats: it only spreads over the surface, and only
+    // while it has company there, so a film thins out and a lone drop comes to rest
+    if constexpr (M.kind == MoveKind::LIQUID)
+    {
+        const MaterialTraits &below = materialTraits(m_types[idx(x, y + 1)]);
+        if (below.kind == MoveKind::LIQUID && below.density > M.density)
+        {
+            bool film = (x > 0 && m_types[i - 1] == T) || (x + 1 < m_width && m_types[i + 1] == T);
+            int tx = film ? spreadTarget(x, y, rng.bit() ? -1 : 1, M.dispersion, canDisplace) : x;
+            if (tx != x)
             {
-                cell.velocityY = 0;
+                swapCells(x, y, tx, y);
+                m_values[i] = 0;
             }
+            m_updated[i] = 1;
+            return;
+        }
+    }
+
+    // Increase velocity due to gravity
+    int velocityY = std::min(m_values[i] + M.gravity, static_cast<int>(M.maxVelocity));
+    m_values[i] = static_cast<uint16_t>(velocityY);
+
+    // Fall through everything this material displaces, up to its velocity. Always at least a
+    // cell, or a cell starting from rest over a one-cell gap would never drop into it.
+    int targetY = std::min(y + std::max(velocityY / VELOCITY_SCALE, 1), m_height - 1);
+    int newY = y + 1;
+    while (newY <= targetY && canDisplace[static_cast<int>(m_types[idx(x, newY)])])
+        newY++;
+    newY--; // Step back to last valid position
+
+    // A cell at full speed with open air ahead leaves the grid, it lands wherever the fall ends
+    if (velocityY == M.maxVelocity && newY == targetY && targetY < m_height - 1)
+    {
+        int airY = y + 1;
+        while (airY <= targetY && m_types[idx(x, airY)] == PixelType::EMPTY)
+            airY++;
+        if (airY > targetY)
+        {
+            launch(x, y, velocityY);
+            return;
+        }
+    }
+
+    if (newY > y)
+    {
+        swapCells(x, y, x, newY);
+    }
+    else
+    {
+        // Try to slide down a diagonal, liquids then spread sideways
+        int nx = x + (rng.bit() ? -1 : 1);
+        if (nx >= 0 && nx < m_width && canDisplace[static_cast<int>(m_types[idx(nx, y + 1)])])
+        {
+            swapCells(x, y, nx, y + 1);
+            m_values[i] = M.slideVelocity;
+        }
+        else if (int tx = M.dispersion > 0 ? spreadTarget(x, y, nx - x, M.dispersion, canDisplace) : x; tx != x)
+        {
+            swapCells(x, y, tx, y);
+            m_values[i] = 0;
         }
         else
         {
-            cell.velocityY = 0;
+            // Only one diagonal was tried, a cell next to an open one stays awake to try again
+            m_values[i] = 0;
+            int ox = 2 * x - nx;
+            if (ox >= 0 && ox < m_width && canDisplace[static_cast<int>(m_types[idx(ox, y + 1)])])
+                wakeCell(x, y);
         }
     }
 
-    cell.updated = true;
+    m_updated[i] = 1;
 }
 
-void PixelWorld::updateFire(int x, int y, float dt)
+void PixelWorld::launch(int x, int y, int velocityY)
 {
-    static float fireSpreadChance = 0.3f;
-    static float fireRiseChance = 0.7f;
-
     int i = idx(x, y);
-    Pixel &cell = m_pixels[i];
+    ParticleLaunch launch{x, y, velocityY, m_types[i]};
+    m_types[i] = PixelType::EMPTY;
+    m_values[i] = 0;
+    m_updated[i] = 1;
+    wakeCell(x, y);
 
-    cell.lifetime -= dt * (1.0f + GetRandomValue(0, 100) / 100.0f);
+    Chunk &chunk = m_chunks[(y / CHUNK_SIZE) * m_chunksX + x / CHUNK_SIZE];
+    std::unique_lock<std::mutex> lock(m_chunkLocks[&chunk - m_chunks.data()], std::defer_lock);
+    if (m_concurrentWakes)
+        lock.lock();
+    chunk.launched.push_back(launch);
+}
 
-    if (cell.lifetime <= 0 || (cell.lifetime < 0.5f && GetRandomValue(0, 100) < 5))
+void PixelWorld::updateParticles()
+{
+    // Cells launched this frame join in chunk order, so seeded runs replay the same
+    for (Chunk &chunk : m_chunks)
     {
-        cell = {};
+        for (const ParticleLaunch &l : chunk.launched)
+            m_particles.add(l.x, l.y, 0, l.velocityY, l.type, 0);
+        chunk.launched.clear();
+    }
+    if (m_particles.empty())
         return;
+
+    PROFILE_SCOPE("world.particles");
+    m_particles.integrate();
+    for (int i = 0; i < m_particles.size();)
+    {
+        if (flyParticle(i))
+            i++;
+        else
+            m_particles.remove(i);
     }
+}
+
+bool PixelWorld::flyParticle(int i)
+{
+    // Every cell on the way is checked, but only by its type byte
+    const int x0 = m_particles.fromX(i), y0 = m_particles.fromY(i);
+    const int x1 = m_particles.cellX(i), y1 = m_particles.cellY(i);
+    const int steps = std::max(std::abs(x1 - x0), std::abs(y1 - y0));
+    // Steps of one cell along the longer axis, the other advancing in 16.16 fixed point
+    const int stepX = steps ? ((x1 - x0) << 16) / steps : 0;
+    const int stepY = steps ? ((y1 - y0) << 16) / steps : 0;
+    int fx = (x0 << 16) + 0x8000, fy = (y0 << 16) + 0x8000;
+    int lastX = x0, lastY = y0;
+    for (int step = 1; step <= steps; step++)
+    {
+        fx += stepX;
+        fy += stepY;
+        int x = fx >> 16, y = fy >> 16;
+        if (x < 0 || x >= m_width || y >= m_height)
+            break; // the grid's sides and floor are walls
+        if (y >= 0)
+        {
+            PixelType hit = m_types[idx(x, y)];
+            if (hit != PixelType::EMPTY)
+            {
+                if (materialTraits(hit).kind == MoveKind::LIQUID && m_particles.speed(i) >= SPLASH_SPEED)
+                    splash(x, y, m_particles.speed(i));
+                break;
+            }
+        }
+        lastX = x;
+        lastY = y; // open air, or above the grid
+    }
+    if (lastX == x1 && lastY == y1)
+        return true;
+
+    if (landParticle(i, lastX, lastY))
+        return false;
+
+    // Its column is full to the top: it waits there and drops again next frame, nudged sideways
+    Random &rng = m_chunks[(std::max(lastY, 0) / CHUNK_SIZE) * m_chunksX + lastX / CHUNK_SIZE].random;
+    m_particles.place(i, lastX, lastY, rng.bit() ? -VELOCITY_SCALE : VELOCITY_SCALE, 0);
+    return true;
+}
+
+bool PixelWorld::landParticle(int i, int x, int y)
+{
+    // Whatever filled the spot since the particle passed it, the particle ends up on top
+    int landY = y;
+    while (landY >= 0 && m_types[idx(x, landY)] != PixelType::EMPTY)
+        landY--;
+    if (landY < 0)
+        return false;
+
+    // Falling cells keep falling on the grid at the speed they arrived with
+    PixelType type = m_particles.type(i);
+    const MaterialTraits &traits = materialTraits(type);
+    int k = idx(x, landY);
+    m_types[k] = type;
+    if (type == PixelType::FIRE)
+        m_values[k] = m_particles.value(i);
+    else if (isFalling(type))
+        m_values[k] = static_cast<uint16_t>(std::clamp(m_particles.velocityY(i), 0, static_cast<int>(traits.maxVelocity)));
+    else
+        m_values[k] = 0;
+    m_updated[k] = 1;
+    if (type == PixelType::FIRE)
+        listFire(k);
+    wakeCell(x, landY);
+    return true;
+}
+
+void PixelWorld::splash(int x, int y, int speed)
+{
+    Random &rng = m_chunks[(y / CHUNK_SIZE) * m_chunksX + x / CHUNK_SIZE].random;
+    for (int dx = -SPLASH_REACH; dx <= SPLASH_REACH; dx++)
+    {
+        // Only surface cells go, the ones with air above
+        int sx = x + dx;
+        if (sx < 0 || sx >= m_width || (y > 0 && m_types[idx(sx, y - 1)] != PixelType::EMPTY))
+            continue;
+        int i = idx(sx, y);
+        if (materialTraits(m_types[i]).kind != MoveKind::LIQUID)
+            continue;
+
+        int up = speed * VELOCITY_SCALE / 2 - rng.range(0, VELOCITY_SCALE);
+        int out = dx * speed * VELOCITY_SCALE / (2 * SPLASH_REACH) + rng.range(-VELOCITY_SCALE / 2, VELOCITY_SCALE / 2);
+        m_particles.add(sx, y, out, -up, m_types[i], 0);
+        m_types[i] = PixelType::EMPTY;
+        m_values[i] = 0;
+        wakeCell(sx, y);
+    }
+}
+
+void PixelWorld::blast(const EditCommand &command, DirtyRect &bounds)
+{
+    const int r = std::max(command.radius, 1);
+    for (int y = std::max(command.y0 - r, 0); y <= std::min(command.y0 + r, m_height - 1); y++)
+    {
+        for (int x = std::max(command.x0 - r, 0); x <= std::min(command.x0 + r, m_width - 1); x++)
+        {
+            int dx = x - command.x0, dy = y - command.y0;
+            int distSq = dx * dx + dy * dy;
+            int i = idx(x, y);
+            if (distSq > r * r || m_types[i] == PixelType::EMPTY)
+                continue;
+
+            // Straight out from the centre, integer math so seeded runs replay anywhere
+            int dist = std::max(static_cast<int>(std::sqrt(static_cast<double>(distSq))), 1);
+            int speed = BLAST_SPEED * VELOCITY_SCALE * (2 * r - dist) / (2 * r);
+            int vx = dx * speed / dist + m_random.range(-VELOCITY_SCALE / 2, VELOCITY_SCALE / 2);
+            int vy = dy * speed / dist - BLAST_LIFT * VELOCITY_SCALE + m_random.range(-VELOCITY_SCALE / 2, VELOCITY_SCALE / 2);
+            m_particles.add(x, y, vx, vy, m_types[i], m_types[i] == PixelType::FIRE ? m_values[i] : 0);
+            m_types[i] = PixelType::EMPTY;
+            m_values[i] = 0;
+            bounds.include(x, y, x, y);
+        }
+    }
+}
+
+int PixelWorld::spreadTarget(int x, int y, int dir, int reach, const bool *canDisplace) const
+{
+    int target = x;
+    for (int step = 1; step <= reach; step++)
+    {
+        int nx = x + dir * step;
+        if (nx < 0 || nx >= m_width || m_types[idx(nx, y)] != PixelType::EMPTY)
+            break;
+        target = nx;
+        if (canDisplace[static_cast<int>(m_types[idx(nx, y + 1)])])
+            break; // falls from here next frame
+    }
+    return target;
+}
+
+int PixelWorld::updateFire(int x, int y, float dt, Random &rng)
+{
+    static float fireSpreadChance = 0.3f;
+    static float fireRiseChance = 0.7f;
+
+    int i = idx(x, y);
+    if (!burn(x, y, dt, rng))
+        return -1;
 
     bool moved = false;
 
-    if (y > 0 && GetRandomValue(0, 100) / 100.0f < fireRiseChance)
+    if (y > 0 && rng.range(0, 100) / 100.0f < fireRiseChance)
     {
-        int above = idx(x, y - 1);
-        if (m_pixels[above].type == PixelType::EMPTY)
+        if (m_types[idx(x, y - 1)] == PixelType::EMPTY)
         {
-            std::swap(cell, m_pixels[above]);
+            swapCells(x, y, x, y - 1);
             moved = true;
+            y--;
         }
     }
 
-    if (!moved && GetRandomValue(0, 100) / 100.0f < fireSpreadChance)
+    if (!moved && rng.range(0, 100) / 100.0f < fireSpreadChance)
     {
-        int dir = GetRandomValue(0, 1) ? -1 : 1;
+        int dir = rng.bit() ? -1 : 1;
         int nx = x + dir;
 
         if (nx >= 0 && nx < m_width)
         {
-            int side = idx(nx, y);
-            if (m_pixels[side].type == PixelType::EMPTY)
+            if (m_types[idx(nx, y)] == PixelType::EMPTY)
             {
-                std::swap(cell, m_pixels[side]);
+                swapCells(x, y, nx, y);
                 moved = true;
+                x = nx;
             }
         }
     }
 
-    if (cell.lifetime < 0.8f && GetRandomValue(0, 100) < 2)
+    // Below 0.8s left
+    if (m_values[i] * 5 < LIFETIME_SCALE * 4 && rng.range(0, 100) < 2)
     {
-        cell.type = PixelType::EMPTY;
+        m_types[i] = PixelType::EMPTY;
+        m_values[i] = 0;
     }
-}
-
-void PixelWorld::updateOil(int x, int y)
-{
-    static const float GRAVITY = 0.04f;
-    static const float MAX_VELOCITY = 2.5f;
 
-    Pixel &cell = m_pixels[idx(x, y)];
-    if (cell.updated)
-        return;
+    int at = idx(x, y);
+    if (m_types[at] != PixelType::FIRE)
+        return -1;
 
-    // Check for fire nearby and ignite oil
+    // Fire lights what it touches; flammable cells never look for fire themselves
     const int dirs[4][2] = {{0, 1}, {0, -1}, {1, 0}, {-1, 0}};
     for (auto &d : dirs)
     {
         int nx = x + d[0];
         int ny = y + d[1];
-        if (nx >= 0 && nx < m_width && ny >= 0 && ny < m_height)
-        {
-            Pixel &neighbor = m_pixels[idx(nx, ny)];
-            if (neighbor.type == PixelType::FIRE)
-            {
-                cell.type = PixelType::FIRE;
-                cell.lifetime = 2.0f + GetRandomValue(0, 1000) / 1000.0f * 2.0f;
-                cell.velocityY = 0;
-                cell.updated = true;
-                return;
-            }
-        }
+        if (nx < 0 || nx >= m_width || ny < 0 || ny >= m_height)
+            continue;
+        if (materialTraits(m_types[idx(nx, ny)]).flammable)
+            ignite(nx, ny, rng);
+    }
+    return at;
+}
+
+bool PixelWorld::burn(int x, int y, float dt, Random &rng)
+{
+    int i = idx(x, y);
+
+    // Burn for 1-2x dt
+    int burn = static_cast<int>(dt * (100 + rng.range(0, 100)) * (LIFETIME_SCALE / 100.0f));
+    int lifetime = std::max(m_values[i] - burn, 0);
+    m_values[i] = static_cast<uint16_t>(lifetime);
+
+    // Burning cells change every frame, so they keep their surroundings awake
+    wakeCell(x, y);
+
+    // Fire heats its sample, and can't keep burning in one that water has cooled
+    int heat = m_heat.atCell(x, y);
+    if (m_heat.addAtCell(x, y, std::clamp(FLAME_HEAT - heat, 0, static_cast<int>(materialTraits(PixelType::FIRE).heat))) < QUENCH_HEAT)
+    {
+        m_types[i] = PixelType::EMPTY;
+        m_values[i] = 0;
+        return false;
     }
 
-    // Oil floats on water - check if there's water below and don't fall through it
-    if (y + 1 < m_height)
+    if (lifetime <= 0 || (lifetime < LIFETIME_SCALE / 2 && rng.range(0, 100) < 5))
     {
-        Pixel &below = m_pixels[idx(x, y + 1)];
-        if (below.type == PixelType::WATER)
-        {
-            // Oil should stay on top of water, don't swap
-            // Instead try to move sideways if possible
-            int dir = GetRandomValue(0, 1) ? -1 : 1;
-            int nx = x + dir;
+        m_types[i] = PixelType::EMPTY;
+        m_values[i] = 0;
+        return false;
+    }
+    return true;
+}
 
-            if (nx >= 0 && nx < m_width && m_pixels[idx(nx, y)].type == PixelType::EMPTY)
+void PixelWorld::levelLiquids()
+{
+    PROFILE_SCOPE("world.levelling");
+    m_levelColumns.assign(m_width, {});
+    for (int y = 1; y < m_height; y++)
+    {
+        // A run can reach across chunks, sleeping ones too, and is levelled once
+        int runEnd = -1;
+        Chunk *row = &m_chunks[(y / CHUNK_SIZE) * m_chunksX];
+        for (int cx = 0; cx < m_chunksX; cx++)
+        {
+            const DirtyRect &r = row[cx].current;
+            if (r.empty() || y < r.minY || y > r.maxY)
+                continue;
+            int from = std::max(r.minX, runEnd + 1);
+            if (from > r.maxX)
+                continue;
+            uint64_t mask = classifyRow(&m_types[idx(from, y)], r.maxX - from + 1, CLASS_LIQUID);
+            while (mask)
             {
-                std::swap(cell, m_pixels[idx(nx, y)]);
-                cell.velocityY = 0;
+                int x = from + std::countr_zero(mask);
+                mask &= mask - 1;
+                if (x <= runEnd)
+                    continue;
+                PixelType type = m_types[idx(x, y)];
+                int x0 = x, x1 = x;
+                while (x0 > 0 && m_types[idx(x0 - 1, y)] == type)
+                    x0--;
+                while (x1 < m_width - 1 && m_types[idx(x1 + 1, y)] == type)
+                    x1++;
+                levelRun(y, x0, x1, type);
+                runEnd = x1;
             }
-            cell.updated = true;
-            return;
         }
     }
+}
 
-    // Normal falling behavior through empty space
-    cell.velocityY = std::min(cell.velocityY + GRAVITY, MAX_VELOCITY);
-    int targetY = y + static_cast<int>(cell.velocityY);
-    targetY = std::min(targetY, m_height - 1);
-
-    int newY = y + 1;
-    while (newY <= targetY && newY < m_height)
+void PixelWorld::levelRun(int y, int x0, int x1, PixelType liquid)
+{
+    // Gaps in the surface resting right on the run
+    m_levelHoles.clear();
+    for (int x = x0; x <= x1; x++)
     {
-        PixelType belowType = m_pixels[idx(x, newY)].type;
-        if (belowType != PixelType::EMPTY)
-            break;
-        newY++;
+        if (m_types[idx(x, y - 1)] == PixelType::EMPTY)
+            m_levelHoles.push_back(x);
     }
-    newY--;
+    if (m_levelHoles.empty())
+        return;
 
-    if (newY > y)
+    // Columns standing on the run at least two cells high, so every move drops its cell
+    m_levelTops.clear();
+    for (int x = x0; x <= x1; x++)
     {
-        std::swap(cell, m_pixels[idx(x, newY)]);
+        if (m_types[idx(x, y - 1)] != liquid)
+            continue;
+        int top = columnTop(x, y - 1, liquid);
+        if (top <= y - 2)
+            m_levelTops.push_back({top, x});
     }
-    else
+
+    // Tallest columns first; the run connects them all, so any gap will do
+    std::sort(m_levelTops.begin(), m_levelTops.end());
+    size_t moves = std::min(m_levelTops.size(), m_levelHoles.size());
+    for (size_t k = 0; k < moves; k++)
     {
-        // Try diagonal movement first
-        int dir = GetRandomValue(0, 1) ? -1 : 1;
-        int nx = x + dir;
+        auto [top, x] = m_levelTops[k];
+        int hole = m_levelHoles[k];
+        swapCells(x, top, hole, y - 1);
+        m_values[idx(hole, y - 1)] = 0;
+        m_levelColumns[x].top = top + 1;
+        m_levelColumns[hole].bottom = -1;
+    }
+}
 
-        if (nx >= 0 && nx < m_width && y + 1 < m_height &&
-            m_pixels[idx(nx, y + 1)].type == PixelType::EMPTY)
-        {
-            std::swap(cell, m_pixels[idx(nx, y + 1)]);
-            cell.velocityY = 0.5f;
-        }
-        else if (nx >= 0 && nx < m_width && m_pixels[idx(nx, y)].type == PixelType::EMPTY)
+int PixelWorld::columnTop(int x, int bottom, PixelType liquid)
+{
+    // Rows are levelled top-down, so the column known from a row above usually just grows
+    // down to this one; each cell is climbed about once per update
+    LevelColumn &column = m_levelColumns[x];
+    if (column.bottom >= 0 && column.bottom < bottom && column.type == liquid)
+    {
+        int y = column.bottom + 1;
+        while (y <= bottom && m_types[idx(x, y)] == liquid)
+            y++;
+        if (y > bottom)
         {
-            // Try horizontal movement
-            std::swap(cell, m_pixels[idx(nx, y)]);
-            cell.velocityY = 0;
+            column.bottom = bottom;
+            return column.top;
         }
-        else
+    }
+    else if (column.bottom == bottom && column.type == liquid)
+    {
+        return column.top;
+    }
+
+    int top = bottom;
+    while (top > 0 && m_types[idx(x, top - 1)] == liquid)
+        top--;
+    column = {bottom, top, liquid};
+    return top;
+}
+
+void PixelWorld::ignite(int x, int y, Random &rng)
+{
+    int i = idx(x, y);
+    m_types[i] = PixelType::FIRE;
+    m_values[i] = randomFireLifetime(rng);
+    m_updated[i] = 1;
+    wakeCell(x, y);
+    listFire(i);
+    PROFILE_COUNT(FIRES_IGNITED, 1);
+}
+
+void PixelWorld::updateHeat()
+{
+    // With nothing burning and nothing warm, heat costs nothing
+    bool burning = std::any_of(m_chunks.begin(), m_chunks.end(), [](const Chunk &chunk) { return !chunk.fires.empty(); });
+    if (!burning && !m_heat.active())
+        return;
+
+    PROFILE_SCOPE("world.heat");
+    m_heat.step();
+
+    // Only warm samples look at their cells, a handful around each fire
+    const int S = HeatField::SAMPLE;
+    for (int sy = 0; sy < m_heat.height(); sy++)
+    {
+        for (int sx = 0; sx < m_heat.width(); sx++)
         {
-            cell.velocityY = 0;
+            int heat = m_heat.at(sx, sy);
+            if (heat <= 0)
+                continue;
+
+            int x0 = sx * S, y0 = sy * S;
+            Random &rng = m_chunks[(y0 / CHUNK_SIZE) * m_chunksX + x0 / CHUNK_SIZE].random;
+            int cooling = 0;
+            for (int y = y0; y < std::min(y0 + S, m_height); y++)
+            {
+                for (int x = x0; x < std::min(x0 + S, m_width); x++)
+                {
+                    const MaterialTraits &m = materialTraits(m_types[idx(x, y)]);
+                    if (m.heat < 0)
+                        cooling += m.heat;
+                    else if (m.ignition && heat >= m.ignition && rng.range(0, HEAT_IGNITION_ODDS - 1) == 0)
+                        ignite(x, y, rng);
+                }
+            }
+            if (cooling)
+                m_heat.add(sx, sy, std::max(cooling, COLDEST_HEAT - heat));
         }
     }
-
-    cell.updated = true;
-}
\ No newline at end of file
+}
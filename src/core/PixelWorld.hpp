@@ -1,52 +1,347 @@
 #pragma once
+#include <cstdint>
 #include <vector>
-#include <raylib.h>
+#include <memory>
+#include <mutex>
 #include <functional>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include "Bitplanes.hpp"
+#include "EditBuffer.hpp"
+#include "HeatField.hpp"
+#include "Margolus.hpp"
+#include "Materials.hpp"
+#include "Particles.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
 
-enum class PixelType
+enum class UpdateMode
 {
-    EMPTY,
-    SAND,
-    WATER,
-    STONE,
-    FIRE,
-    OIL,
+    SERIAL,       // whole rows bottom-up on the calling thread
+    CHECKERBOARD, // chunks on the worker pool in 4 alternating phases
+    BITPLANE,     // whole rows as per-material bitplanes on the calling thread, single-cell falls
+    MARGOLUS,     // 2x2 blocks at both grid offsets each frame, table rules, chunk rows on the worker pool
 };
 
-// Packed struct for better memory efficiency
-struct alignas(8) Pixel
+// Every mode, in declaration order
+inline constexpr UpdateMode UPDATE_MODES[] = {UpdateMode::SERIAL, UpdateMode::CHECKERBOARD, UpdateMode::BITPLANE,
+                                              UpdateMode::MARGOLUS};
+
+inline const char *updateModeName(UpdateMode mode)
+{
+    switch (mode)
+    {
+    case UpdateMode::SERIAL: return "serial";
+    case UpdateMode::CHECKERBOARD: return "checkerboard";
+    case UpdateMode::BITPLANE: return "bitplane";
+    case UpdateMode::MARGOLUS: return "margolus";
+    }
+    return "unknown";
+}
+
+// Unpacked copy of one cell
+struct Pixel
+{
+    PixelType type = PixelType::EMPTY;
+    float lifetime = 0.0f;  // seconds left to burn (fire only)
+    float velocityY = 0.0f; // cells per frame (falling materials only)
+};
+
+// Read-only view over the cell planes
+struct PixelView
 {
-    PixelType type : 4; // 4 bits for type (0-15 possible values)
-    bool updated : 1;   // 1 bit for update flag
-    float lifetime;     // 4 bytes for lifetime
-    float velocityY;    // 4 bytes for vertical velocity
+    const PixelType *types; // one material ID byte per cell
+    const uint16_t *values; // velocityY or lifetime in steps, see VELOCITY_SCALE
+    int width, height;
 
-    Pixel() : type(PixelType::EMPTY), updated(false), lifetime(0.0f), velocityY(0.0f) {}
+    Pixel operator[](int i) const
+    {
+        Pixel p;
+        p.type = types[i];
+        if (p.type == PixelType::FIRE)
+            p.lifetime = values[i] / static_cast<float>(LIFETIME_SCALE);
+        else
+            p.velocityY = values[i] / static_cast<float>(VELOCITY_SCALE);
+        return p;
+    }
+    int size() const { return width * height; }
+};
+
+// Owned copy of the cell planes, for saving and for handing frames to other threads
+struct WorldFrame
+{
+    int width = 0, height = 0;
+    std::vector<PixelType> types;
+    std::vector<uint16_t> values;
+
+    PixelView view() const { return {types.data(), values.data(), width, height}; }
+};
+
+struct ChunkCells;
+
+// Inclusive cell rectangle, empty while minX > maxX
+struct DirtyRect
+{
+    int minX = 1, minY = 1, maxX = 0, maxY = 0;
+
+    bool empty() const { return minX > maxX; }
+    void reset() { *this = {}; }
+    void include(int x0, int y0, int x1, int y1)
+    {
+        if (empty())
+        {
+            minX = x0, minY = y0, maxX = x1, maxY = y1;
+            return;
+        }
+        if (x0 < minX) minX = x0;
+        if (y0 < minY) minY = y0;
+        if (x1 > maxX) maxX = x1;
+        if (y1 > maxY) maxY = y1;
+    }
+};
+
+// Fixed-size block of the grid that only gets simulated while something in it is awake
+struct Chunk
+{
+    DirtyRect current; // cells simulated this frame
+    DirtyRect next;    // cells woken for the next frame
+    DirtyRect changed; // cells changed since the last takeChangedRects()
+    Random random;     // stream for cells simulated in this chunk, whichever thread runs it
+
+    // Burning cells in this chunk, may repeat or hold cells that went out since
+    std::vector<int> fires;
+    std::vector<int> firesTaken; // the list the fire pass is working through
+
+    // Falling cells that left the grid this frame, for the particle pass
+    std::vector<ParticleLaunch> launched;
+
+    // Updates in a row its awake cells were held back by the update budget, 0 while it runs
+    int deferred = 0;
 };
 
 class PixelWorld
 {
 public:
-    PixelWorld(int width, int height);
+    static constexpr int CHUNK_SIZE = 64;
+
+    PixelWorld(int width, int height, uint64_t seed = 0);
     void clear();
     void addPixel(int x, int y, PixelType type);
     void update(float dt);
 
+    // Applies recorded edits now, one span write per covered row. Edit coordinates are world
+    // cells, shifted by origin() and clipped to the grid.
+    void applyEdits(const EditBuffer &edits);
+    // Safe from any thread, the edits are applied at the start of the next update()
+    void queueEdits(const EditBuffer &edits);
+
     int width() const { return m_width; }
     int height() const { return m_height; }
-    const std::vector<Pixel> &data() const { return m_pixels; }
+    PixelView data() const { return {m_types.data(), m_values.data(), m_width, m_height}; }
+    const std::vector<PixelType> &types() const { return m_types; }
+
+    // Copies the cell planes out, cheap enough to do every frame
+    void copyFrame(WorldFrame &frame) const;
+    // Replaces the world with a frame, cropping or padding when the sizes differ
+    void loadFrame(const WorldFrame &frame);
+
+    // World cell at the grid's top left, always a multiple of CHUNK_SIZE
+    int originX() const { return m_originX; }
+    int originY() const { return m_originY; }
+    // Slides the grid to a new origin by whole chunks. The overlap keeps its cells and wake
+    // state, chunks that scroll in come up empty.
+    void moveOrigin(int originX, int originY);
+    // Copies chunk cx,cy of the grid out, cells past the grid's edge read as empty
+    void copyChunk(int cx, int cy, ChunkCells &cells) const;
+    // Replaces chunk cx,cy of the grid and wakes it, along with the cells bordering it
+    void loadChunk(int cx, int cy, const ChunkCells &cells);
+
+    // Restarts every random stream, the same seed and edits replay bit-identically
+    void seed(uint64_t seed);
+    // Stream for edits and tools on the calling thread
+    Random &random() { return m_random; }
+
+    // Hands out the regions changed since the last call, at most one per chunk
+    void takeChangedRects(std::vector<DirtyRect> &rects);
+
+    int chunksX() const { return m_chunksX; }
+    int chunksY() const { return m_chunksY; }
+    int chunkCount() const { return static_cast<int>(m_chunks.size()); }
+    // Chunks with awake cells, held back ones included
+    int activeChunkCount() const { return m_activeChunks; }
+
+    void setUpdateMode(UpdateMode mode) { m_updateMode = mode; }
+    UpdateMode updateMode() const { return m_updateMode; }
+    void setThreadCount(int count);
+    int threadCount() const { return m_pool->threadCount(); }
+
+    // Budgeted updates: each update simulates the awake chunks around the focus, then as many
+    // of the others as the budget is expected to cover, taking turns from where the last one
+    // stopped. Held back chunks stay awake and run on a later update, so far regions just run
+    // at a lower rate. 0 simulates everything; budgeted runs depend on timing and don't replay.
+    void setUpdateBudget(float ms) { m_budgetMs = ms; }
+    float updateBudget() const { return m_budgetMs; }
+    // World cell the budget favours, such as the cursor
+    void setFocus(int x, int y) { m_focusX = x, m_focusY = y; }
+    // Awake chunks the last update held back, and the most updates in a row one of them waited
+    int deferredChunkCount() const { return m_deferredChunks; }
+    int maxDeferredUpdates() const { return m_maxDeferred; }
+
+    // Levels liquid pools in bulk: the top of a column standing two or more cells taller than
+    // a gap in the surface of the same pool moves straight into the gap. Off unless asked for.
+    void setLiquidLevelling(bool enabled) { m_levelling = enabled; }
+    bool liquidLevelling() const { return m_levelling; }
+
+    // Cells in free flight: fast falls and blasts leave the grid as particles and land back
+    // into it, so a frame costs per particle rather than per cell crossed
+    const ParticleLayer &particles() const { return m_particles; }
+    int particleCount() const { return m_particles.size(); }
+
+    // Coarse temperature over the grid, stepped each update while anything is burning or warm
+    const HeatField &heat() const { return m_heat; }
+
+    // Visit only the cells a row pass cares about via SIMD-built bitmasks, off scans every cell
+    void setRowMasks(bool enabled) { m_rowMasks = enabled; }
+    bool rowMasks() const { return m_rowMasks; }
 
 private:
     int m_width, m_height;
-    std::vector<Pixel> m_pixels;
+    int m_originX = 0, m_originY = 0;
+
+    // Structure-of-arrays cell storage, 4 bytes per cell in total
+    std::vector<PixelType> m_types;
+    std::vector<uint8_t> m_updated; // 1 once the cell has been simulated this frame
+    std::vector<uint16_t> m_values; // velocityY or fire lifetime, see VELOCITY_SCALE
+    HeatField m_heat;
+    ParticleLayer m_particles;
+    BitplaneRows m_bitplanes;
+    std::vector<uint64_t> m_bitplaneAwake;   // one word per chunk of the row being stepped
+    std::vector<uint64_t> m_bitplaneRandom;
+    std::vector<uint64_t> m_bitplaneChanged;
+
+    int m_chunksX, m_chunksY;
+    std::vector<Chunk> m_chunks;
+    int m_activeChunks = 0;
+    Random m_random;
+
+    UpdateMode m_updateMode = UpdateMode::SERIAL;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::unique_ptr<std::mutex[]> m_chunkLocks; // guard Chunk::next while workers run
+    bool m_concurrentWakes = false;
+    std::vector<int> m_phaseChunks;
+    float m_budgetMs = 0.0f;
+    int m_focusX = 0, m_focusY = 0;
+    float m_cellNs = 10.0f;      // measured cost of an awake cell in the movement passes
+    int m_budgetCursor = 0;      // chunk the next turn of held back chunks starts from
+    int m_deferredChunks = 0, m_maxDeferred = 0;
+    bool m_rowMasks = true;
+    bool m_levelling = false;
+    std::vector<int> m_levelHoles;
+    std::vector<std::pair<int, int>> m_levelTops; // y, x
+
+    // Liquid column climbed by levelling this update, bottom is -1 until one is known
+    struct LevelColumn
+    {
+        int bottom = -1, top = 0;
+        PixelType type = PixelType::EMPTY;
+    };
+    std::vector<LevelColumn> m_levelColumns;
+
+    std::mutex m_editMutex; // guards m_queuedEdits
+    EditBuffer m_queuedEdits;
+    EditBuffer m_applyingEdits;
+    std::vector<std::pair<int, int>> m_floodStack;
+
+    // Holds back the awake chunks the update budget doesn't cover
+    void scheduleChunks();
+    void updateSerial(float dt);
+    void updateCheckerboard(float dt);
+    void updateRow(int y, int x0, int x1, Random &rng);
+    // Falling pass of BITPLANE mode, bottom-up over every row with an awake chunk
+    void updateBitplanes();
+    // Writes words first..last of a stepped bitplane row back to the cells and wakes around
+    // whatever changed
+    void storeBitplaneRow(int y, int first, int last, bool lower);
+    // MARGOLUS mode: every awake block at both offsets, one phase of chunk rows after the
+    // other. Blocks burn fire down only when given a dt.
+    void updateMargolus(float dt);
+    void updateMargolusRows(int cy, int offset, float dt);
+    void updateBlock(int x, int y, const MargolusRules &rules, Random &rng, float dt);
+    void updateFires(Chunk &chunk, float dt);
+    // Flies every particle one frame, landing those that hit something
+    void updateParticles();
+    // Walks particle i from the cell it left to its new one, false once it has landed
+    bool flyParticle(int i);
+    // Writes particle i into the first empty cell at or above x,y, false when there is none
+    bool landParticle(int i, int x, int y);
+    // Throws the liquid surface around x,y up as particles, for an impact of speed cells per frame
+    void splash(int x, int y, int speed);
+    // Queues the falling cell at x,y to leave the grid with velocityY
+    void launch(int x, int y, int velocityY);
 
-    void updateSand(int x, int y);
-    void updateWater(int x, int y);
-    void updateFire(int x, int y, float dt);
-    void updateOil(int x, int y);
+    // One movement kernel for every falling material, specialised on its MaterialTraits
+    template <PixelType T>
+    void updateFalling(int x, int y, Random &rng);
+    // Empty cell furthest along row y, up to reach cells towards dir, stopping over the first
+    // drop; x itself when the next cell is taken
+    int spreadTarget(int x, int y, int dir, int reach, const bool *canDisplace) const;
+    // Returns where the fire ended up, or -1 once it burnt out
+    int updateFire(int x, int y, float dt, Random &rng);
+    // Burns the fire at x,y down by dt and heats its sample, false once it went out
+    bool burn(int x, int y, float dt, Random &rng);
+    void ignite(int x, int y, Random &rng);
+    // Levels the awake rows of every liquid pool, on the calling thread after the movement passes
+    void levelLiquids();
+    void levelRun(int y, int x0, int x1, PixelType liquid);
+    // Topmost row of the unbroken run of liquid in column x that ends at row bottom
+    int columnTop(int x, int bottom, PixelType liquid);
+    // Diffuses heat, then lets warm samples cool over water and light what they hold
+    void updateHeat();
+
+    using CellKernel = void (PixelWorld::*)(int x, int y, Random &rng);
+    template <size_t... I>
+    static constexpr std::array<CellKernel, MATERIAL_COUNT> makeKernels(std::index_sequence<I...>);
+
+    // Writes type over x0..x1 of row y, clipped to the world; returns false when nothing was covered
+    bool paintSpan(int y, int x0, int x1, PixelType type, uint8_t density);
+    void floodFill(const EditCommand &command, DirtyRect &bounds);
+    void blast(const EditCommand &command, DirtyRect &bounds);
+
+    void wakeRegion(int x0, int y0, int x1, int y1);
+    // Lists cell i with its chunk's fires, the fire pass visits nothing else
+    void listFire(int i);
+    // Lists every fire in the region, for cells that arrived without going through an edit
+    void listFires(int x0, int y0, int x1, int y1);
+    void swapCells(int x0, int y0, int x1, int y1);
+
+    // Wake the cell and its 8 neighbours for the next frame
+    inline void wakeCell(int x, int y)
+    {
+        wakeRegion(x - 1, y - 1, x + 1, y + 1);
+    }
 
     inline int idx(int x, int y) const
     {
         return y * m_width + x;
     }
 };
+
+// Cells of one chunk in row order, the unit worlds are paged in and out by
+struct ChunkCells
+{
+    static constexpr int CELLS = PixelWorld::CHUNK_SIZE * PixelWorld::CHUNK_SIZE;
+
+    PixelType types[CELLS];
+    uint16_t values[CELLS];
+
+    bool empty() const
+    {
+        return std::all_of(types, types + CELLS, [](PixelType type) { return type == PixelType::EMPTY; });
+    }
+    void clear()
+    {
+        std::fill_n(types, CELLS, PixelType::EMPTY);
+        std::fill_n(values, CELLS, 0);
+    }
+};
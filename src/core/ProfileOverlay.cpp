@@ -0,0 +1,111 @@
+#include "ProfileOverlay.hpp"
+#include <raylib.h>
+#include <algorithm>
+
+#ifdef SANDBOX_PROFILE
+
+static const char *TRACE_JSON_PATH = "profile_trace.json";
+static const char *TRACE_CSV_PATH = "profile_trace.csv";
+
+static const int GRAPH_SAMPLES = 120; // newest samples drawn per phase
+static const int ROW_HEIGHT = 26;
+static const float GRAPH_MS = 16.7f; // a full-height bar is one 60 Hz frame
+static const double RATE_INTERVAL = 0.5; // seconds between counter rate updates
+
+void ProfileOverlay::handleInput()
+{
+    if (IsKeyPressed(KEY_F2))
+        m_visible = !m_visible;
+
+    if (IsKeyPressed(KEY_F3))
+    {
+        Profiler &profiler = Profiler::get();
+        if (!profiler.capturing())
+        {
+            profiler.startCapture();
+            TraceLog(LOG_INFO, "PROFILER: capture started");
+            return;
+        }
+
+        profiler.stopCapture();
+        bool ok = profiler.writeChromeTrace(TRACE_JSON_PATH);
+        ok = profiler.writeCsv(TRACE_CSV_PATH) && ok;
+        if (ok)
+            TraceLog(LOG_INFO, "PROFILER: capture written to %s and %s", TRACE_JSON_PATH, TRACE_CSV_PATH);
+        else
+            TraceLog(LOG_WARNING, "PROFILER: failed to write the capture");
+    }
+}
+
+void ProfileOverlay::updateRates()
+{
+    double now = GetTime();
+    if (now - m_lastSample < RATE_INTERVAL)
+        return;
+
+    uint64_t totals[PROFILE_COUNTER_COUNT];
+    Profiler::get().counters(totals);
+    float elapsed = static_cast<float>(now - m_lastSample);
+    for (int i = 0; i < PROFILE_COUNTER_COUNT; i++)
+    {
+        m_rates[i] = m_lastSample > 0.0 ? (totals[i] - m_lastTotals[i]) / elapsed : 0.0f;
+        m_lastTotals[i] = totals[i];
+    }
+    m_lastSample = now;
+}
+
+void ProfileOverlay::draw(int x, int y)
+{
+    PROFILE_SAMPLE_COUNTERS();
+    if (Profiler::get().capturing())
+        DrawText("REC", x, y - 20, 16, RED);
+    if (!m_visible)
+        return;
+
+    Profiler::get().phases(m_phases);
+    updateRates();
+
+    const int graphX = x + 260;
+    const int width = graphX - x + GRAPH_SAMPLES * 2 + 10;
+    const int height = static_cast<int>(m_phases.size()) * ROW_HEIGHT + PROFILE_COUNTER_COUNT * 16 + 16;
+    DrawRectangle(x - 5, y - 5, width, height, Fade(BLACK, 0.7f));
+
+    for (const ProfilePhase &phase : m_phases)
+    {
+        float total = 0.0f, worst = 0.0f;
+        for (int i = 0; i < phase.count; i++)
+        {
+            total += phase.historyMs[i];
+            worst = std::max(worst, phase.historyMs[i]);
+        }
+        float mean = phase.count ? total / phase.count : 0.0f;
+        DrawText(TextFormat("%-16s %6.2f avg %6.2f max", phase.name, mean, worst), x, y + 6, 10, WHITE);
+
+        // Oldest sample on the left, each bar one recorded scope
+        int samples = std::min(phase.count, GRAPH_SAMPLES);
+        for (int i = 0; i < samples; i++)
+        {
+            int slot = (phase.next - samples + i + ProfilePhase::HISTORY) % ProfilePhase::HISTORY;
+            float ms = phase.historyMs[slot];
+            int bar = std::max(static_cast<int>(std::min(ms / GRAPH_MS, 1.0f) * (ROW_HEIGHT - 4)), 1);
+            Color color = ms < GRAPH_MS / 2 ? GREEN : ms < GRAPH_MS ? YELLOW : RED;
+            DrawRectangle(graphX + i * 2, y + ROW_HEIGHT - 2 - bar, 2, bar, color);
+        }
+        y += ROW_HEIGHT;
+    }
+
+    y += 8;
+    for (int i = 0; i < PROFILE_COUNTER_COUNT; i++)
+    {
+        DrawText(TextFormat("%-16s %12.0f /s", profileCounterName(static_cast<ProfileCounter>(i)), m_rates[i]),
+                 x, y, 10, WHITE);
+        y += 16;
+    }
+}
+
+#else
+
+void ProfileOverlay::handleInput() {}
+void ProfileOverlay::draw(int, int) {}
+
+#endif
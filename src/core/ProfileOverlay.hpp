@@ -0,0 +1,24 @@
+#pragma once
+#include "Profiler.hpp"
+#include <vector>
+
+// In-app view of the profiler: a rolling graph of each phase's recent durations and the
+// counter rates. F2 shows it, F3 starts a capture and writes it out as a Chrome trace and a
+// CSV when pressed again. Does nothing in builds without SANDBOX_PROFILE.
+class ProfileOverlay
+{
+public:
+    void handleInput();
+    void draw(int x, int y);
+
+private:
+#ifdef SANDBOX_PROFILE
+    void updateRates();
+
+    bool m_visible = false;
+    std::vector<ProfilePhase> m_phases;
+    uint64_t m_lastTotals[PROFILE_COUNTER_COUNT] = {};
+    double m_lastSample = 0.0;
+    float m_rates[PROFILE_COUNTER_COUNT] = {}; // per second
+#endif
+};
@@ -0,0 +1,237 @@
+#include "Profiler.hpp"
+
+#ifdef SANDBOX_PROFILE
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+// A capture stops growing here, about 24 MB of events
+static const size_t MAX_CAPTURE_EVENTS = 1 << 20;
+
+struct TraceEvent
+{
+    const char *name;
+    int thread;
+    int64_t startUs, durationUs;
+};
+
+struct CounterSample
+{
+    int64_t timeUs;
+    uint64_t totals[PROFILE_COUNTER_COUNT];
+};
+
+struct Profiler::Impl
+{
+    std::mutex mutex;
+    Clock::time_point epoch = Clock::now();
+    std::deque<ProfileThread> threads; // a deque so registered threads never move
+    std::vector<ProfilePhase> phases;
+
+    bool capturing = false;
+    std::vector<TraceEvent> events;
+    std::vector<CounterSample> samples;
+
+    int64_t sinceEpochUs(Clock::time_point t) const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - epoch).count();
+    }
+
+    void sumCounters(uint64_t totals[PROFILE_COUNTER_COUNT])
+    {
+        std::fill_n(totals, PROFILE_COUNTER_COUNT, 0);
+        for (const ProfileThread &thread : threads)
+        {
+            for (int i = 0; i < PROFILE_COUNTER_COUNT; i++)
+                totals[i] += thread.counts[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+Profiler &Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() : m_impl(new Impl) {}
+
+ProfileThread *Profiler::registerThread()
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    ProfileThread &thread = m_impl->threads.emplace_back();
+    thread.id = static_cast<int>(m_impl->threads.size());
+    t_thread = &thread;
+    return t_thread;
+}
+
+void Profiler::nameThread(const char *name)
+{
+    ProfileThread *thread = t_thread ? t_thread : registerThread();
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    thread->name = name;
+}
+
+void Profiler::record(const char *name, Clock::time_point start, Clock::time_point end)
+{
+    ProfileThread *thread = t_thread ? t_thread : registerThread();
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+
+    // A handful of phases, and the same literal can live at different addresses per file
+    ProfilePhase *phase = nullptr;
+    for (ProfilePhase &p : m_impl->phases)
+    {
+        if (p.name == name || strcmp(p.name, name) == 0)
+        {
+            phase = &p;
+            break;
+        }
+    }
+    if (!phase)
+        phase = &m_impl->phases.emplace_back(ProfilePhase{name});
+
+    phase->historyMs[phase->next] = std::chrono::duration<float, std::milli>(end - start).count();
+    phase->next = (phase->next + 1) % ProfilePhase::HISTORY;
+    phase->count = std::min(phase->count + 1, ProfilePhase::HISTORY);
+
+    if (m_impl->capturing && m_impl->events.size() < MAX_CAPTURE_EVENTS)
+    {
+        int64_t startUs = m_impl->sinceEpochUs(start);
+        m_impl->events.push_back({name, thread->id, startUs, m_impl->sinceEpochUs(end) - startUs});
+    }
+}
+
+void Profiler::sampleCounters()
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    if (!m_impl->capturing || m_impl->samples.size() >= MAX_CAPTURE_EVENTS)
+        return;
+    CounterSample &sample = m_impl->samples.emplace_back();
+    sample.timeUs = m_impl->sinceEpochUs(Clock::now());
+    m_impl->sumCounters(sample.totals);
+}
+
+void Profiler::phases(std::vector<ProfilePhase> &out)
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    out = m_impl->phases;
+}
+
+void Profiler::counters(uint64_t totals[PROFILE_COUNTER_COUNT])
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->sumCounters(totals);
+}
+
+void Profiler::startCapture()
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->events.clear();
+    m_impl->samples.clear();
+    m_impl->capturing = true;
+}
+
+void Profiler::stopCapture()
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->capturing = false;
+}
+
+bool Profiler::capturing()
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->capturing;
+}
+
+bool Profiler::writeChromeTrace(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    const char *separator = "";
+    for (const ProfileThread &thread : m_impl->threads)
+    {
+        if (thread.name.empty())
+            continue;
+        fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                separator, thread.id, thread.name.c_str());
+        separator = ",\n";
+    }
+    for (const TraceEvent &event : m_impl->events)
+    {
+        fprintf(f, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"dur\": %lld}",
+                separator, event.name, event.thread, static_cast<long long>(event.startUs),
+                static_cast<long long>(event.durationUs));
+        separator = ",\n";
+    }
+
+    // Counters are shown per sample interval, the totals only ever grow
+    for (size_t s = 1; s < m_impl->samples.size(); s++)
+    {
+        const CounterSample &previous = m_impl->samples[s - 1];
+        const CounterSample &sample = m_impl->samples[s];
+        fprintf(f, "%s{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"ts\": %lld, \"args\": {",
+                separator, static_cast<long long>(sample.timeUs));
+        for (int i = 0; i < PROFILE_COUNTER_COUNT; i++)
+        {
+            fprintf(f, "%s\"%s\": %llu", i ? ", " : "", profileCounterName(static_cast<ProfileCounter>(i)),
+                    static_cast<unsigned long long>(sample.totals[i] - previous.totals[i]));
+        }
+        fprintf(f, "}}");
+        separator = ",\n";
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+bool Profiler::writeCsv(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    fprintf(f, "kind,name,thread,start_us,duration_us,value\n");
+    for (const TraceEvent &event : m_impl->events)
+    {
+        fprintf(f, "scope,%s,%d,%lld,%lld,\n", event.name, event.thread, static_cast<long long>(event.startUs),
+                static_cast<long long>(event.durationUs));
+    }
+    for (size_t s = 1; s < m_impl->samples.size(); s++)
+    {
+        const CounterSample &previous = m_impl->samples[s - 1];
+        const CounterSample &sample = m_impl->samples[s];
+        for (int i = 0; i < PROFILE_COUNTER_COUNT; i++)
+        {
+            fprintf(f, "counter,%s,,%lld,%lld,%llu\n", profileCounterName(static_cast<ProfileCounter>(i)),
+                    static_cast<long long>(previous.timeUs), static_cast<long long>(sample.timeUs - previous.timeUs),
+                    static_cast<unsigned long long>(sample.totals[i] - previous.totals[i]));
+        }
+    }
+    return fclose(f) == 0;
+}
+
+const char *profileCounterName(ProfileCounter counter)
+{
+    switch (counter)
+    {
+    case ProfileCounter::CELLS_MOVED:
+        return "cells_moved";
+    case ProfileCounter::SWAPS:
+        return "swaps";
+    case ProfileCounter::FIRES_IGNITED:
+        return "fires_ignited";
+    case ProfileCounter::DRAW_CALLS:
+        return "draw_calls";
+    case ProfileCounter::TEXTURE_UPLOADS:
+        return "texture_uploads";
+    }
+    return "unknown";
+}
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scoped timers and counters for the hot paths. Builds without SANDBOX_PROFILE (a CMake
+// option, off by default) compile every PROFILE_* macro to nothing, so instrumented code
+// costs nothing there.
+//
+//   PROFILE_SCOPE("world.fire");        times the rest of the enclosing block
+//   PROFILE_COUNT(SWAPS, 1);            adds to a counter, lock-free from any thread
+//   PROFILE_THREAD("simulation");       names the calling thread in exported traces
+//   PROFILE_SAMPLE_COUNTERS();          keeps the counters in the capture, once per frame
+
+enum class ProfileCounter : uint8_t
+{
+    CELLS_MOVED,     // cells that changed position, a swap with a liquid moves two
+    SWAPS,
+    FIRES_IGNITED,
+    DRAW_CALLS,
+    TEXTURE_UPLOADS,
+};
+
+constexpr int PROFILE_COUNTER_COUNT = 5;
+
+#ifdef SANDBOX_PROFILE
+
+// Rolling durations of one named scope, newest at history[(next - 1) % HISTORY]
+struct ProfilePhase
+{
+    static constexpr int HISTORY = 240;
+
+    const char *name;
+    float historyMs[HISTORY] = {};
+    int next = 0;
+    int count = 0; // samples held, up to HISTORY
+};
+
+// Counters of one thread. Only the owner writes, so adding needs no read-modify-write.
+struct alignas(64) ProfileThread
+{
+    std::atomic<uint64_t> counts[PROFILE_COUNTER_COUNT] = {};
+    int id = 0;
+    std::string name;
+};
+
+class Profiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static Profiler &get();
+
+    void record(const char *name, Clock::time_point start, Clock::time_point end);
+    void nameThread(const char *name);
+
+    static void count(ProfileCounter counter, uint64_t amount)
+    {
+        ProfileThread *thread = t_thread ? t_thread : get().registerThread();
+        std::atomic<uint64_t> &slot = thread->counts[static_cast<int>(counter)];
+        slot.store(slot.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    // Keeps the counter totals as a trace sample while capturing, call once per frame
+    void sampleCounters();
+
+    // Copies every phase's history, in the order the phases first ran
+    void phases(std::vector<ProfilePhase> &out);
+    // Totals since startup, summed over every thread
+    void counters(uint64_t totals[PROFILE_COUNTER_COUNT]);
+
+    // While capturing, every scope is kept as a trace event
+    void startCapture();
+    void stopCapture();
+    bool capturing();
+    // Chrome trace JSON (chrome://tracing, Perfetto) and one CSV row per event
+    bool writeChromeTrace(const std::string &path);
+    bool writeCsv(const std::string &path);
+
+private:
+    Profiler();
+    ProfileThread *registerThread();
+
+    static inline thread_local ProfileThread *t_thread = nullptr;
+
+    struct Impl;
+    Impl *m_impl; // lives as long as the process, threads may record during static teardown
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name) : m_name(name), m_start(Profiler::Clock::now()) {}
+    ~ProfileScope() { Profiler::get().record(m_name, m_start, Profiler::Clock::now()); }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *m_name;
+    Profiler::Clock::time_point m_start;
+};
+
+const char *profileCounterName(ProfileCounter counter);
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNT(counter, amount) Profiler::count(ProfileCounter::counter, (amount))
+#define PROFILE_THREAD(name) Profiler::get().nameThread(name)
+#define PROFILE_SAMPLE_COUNTERS() Profiler::get().sampleCounters()
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNT(counter, amount) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_SAMPLE_COUNTERS() ((void)0)
+
+#endif
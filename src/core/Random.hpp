@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+
+// xoshiro128** generator. Only 32-bit integer math, so a given seed produces the same
+// sequence on desktop and WebAssembly builds.
+class Random
+{
+public:
+    explicit Random(uint64_t seed = 0) { reseed(seed); }
+
+    void reseed(uint64_t seed)
+    {
+        // Expand the seed with splitmix64 so nearby seeds give unrelated streams
+        for (int i = 0; i < 4; i += 2)
+        {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            z ^= z >> 31;
+            m_state[i] = static_cast<uint32_t>(z);
+            m_state[i + 1] = static_cast<uint32_t>(z >> 32);
+        }
+        m_bits = 0;
+        m_bitCount = 0;
+    }
+
+    uint32_t next()
+    {
+        uint32_t result = rotl(m_state[1] * 5, 7) * 9;
+        uint32_t t = m_state[1] << 9;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 11);
+        return result;
+    }
+
+    // One random bit, 32 of them per generator step
+    bool bit()
+    {
+        if (m_bitCount == 0)
+        {
+            m_bits = next();
+            m_bitCount = 32;
+        }
+        bool b = m_bits & 1;
+        m_bits >>= 1;
+        m_bitCount--;
+        return b;
+    }
+
+    // Uniform int in [min, max], both inclusive like GetRandomValue
+    int range(int min, int max)
+    {
+        uint32_t span = static_cast<uint32_t>(max - min) + 1;
+        return min + static_cast<int>((static_cast<uint64_t>(next()) * span) >> 32);
+    }
+
+    // Uniform float in [0, 1)
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+
+private:
+    static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+    uint32_t m_state[4];
+    uint32_t m_bits;
+    int m_bitCount;
+};
@@ -1,44 +1,238 @@
 #include "Renderer.hpp"
+#include "Profiler.hpp"
 #include <raylib.h>
+#include <algorithm>
+#include <cmath>
 
-void Renderer::draw(const PixelWorld &world)
+#if defined(PLATFORM_WEB)
+#define SHADER_DIR "shaders/web/"
+#else
+#define SHADER_DIR "shaders/desktop/"
+#endif
+
+static constexpr int PALETTE_SIZE = 8; // power of two >= MATERIAL_COUNT, see pixel_world.fs
+static_assert(PALETTE_SIZE >= MATERIAL_COUNT, "palette too small for the material table");
+
+// The shader's time wraps around this often. Fire hashes the frame number into each cell,
+// which after an hour unwrapped leaves float32 too few fractional bits for more than a
+// handful of flicker colours.
+static const double SHADER_TIME_PERIOD = 64.0; // seconds
+
+// Base colour of a material, the palette entry. Empty cells are transparent and let the
+// background show through.
+static Color colorOf(PixelType type)
+{
+    const uint8_t *c = materialTraits(type).color;
+    return {c[0], c[1], c[2], c[3]};
+}
+
+// Frames at 60 Hz, the rate the shader's fire flicker runs at
+static uint32_t flickerFrame()
+{
+    return static_cast<uint32_t>(GetTime() * 60.0);
+}
+
+// The CPU side of the shader's fire: a new colour per cell every frame, from a hash of the
+// cell and the frame rather than a random draw per channel
+static Color cellColor(PixelType type, int x, int y, uint32_t frame)
+{
+    if (type != PixelType::FIRE)
+        return colorOf(type);
+
+    uint32_t h = static_cast<uint32_t>(x) * 0x8DA6B343u ^ static_cast<uint32_t>(y) * 0xD8163841u ^ frame * 0xCB1AB31Fu;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return {static_cast<unsigned char>(100 + ((h & 0xFF) * 101 >> 8)),
+            static_cast<unsigned char>(40 + ((h >> 8 & 0xFF) * 41 >> 8)),
+            static_cast<unsigned char>(10 + ((h >> 16 & 0xFF) * 11 >> 8)), 255};
+}
+
+// Uploads one rect of a full-width plane, packing it first unless it spans whole rows
+template <typename T>
+static void uploadRect(Texture2D texture, const T *plane, const DirtyRect &rect, std::vector<T> &scratch)
+{
+    int w = rect.maxX - rect.minX + 1;
+    int h = rect.maxY - rect.minY + 1;
+    const T *src = plane + rect.minY * texture.width + rect.minX;
+    Rectangle rec = {static_cast<float>(rect.minX), static_cast<float>(rect.minY), static_cast<float>(w), static_cast<float>(h)};
+
+    if (w == texture.width)
+    {
+        UpdateTextureRec(texture, rec, src);
+        PROFILE_COUNT(TEXTURE_UPLOADS, 1);
+        return;
+    }
+
+    scratch.resize(w * h);
+    for (int y = 0; y < h; y++)
+    {
+        std::copy_n(src + y * texture.width, w, scratch.data() + y * w);
+    }
+    UpdateTextureRec(texture, rec, scratch.data());
+    PROFILE_COUNT(TEXTURE_UPLOADS, 1);
+}
+
+void Renderer::load()
+{
+    m_shader = LoadShader(SHADER_DIR "pixel_world.vs", SHADER_DIR "pixel_world.fs");
+
+    // A failed compile hands back raylib's default shader, which has no palette
+    m_paletteLoc = GetShaderLocation(m_shader, "palette");
+    if (m_paletteLoc < 0)
+    {
+        TraceLog(LOG_WARNING, "RENDERER: pixel_world shader unavailable, colouring on the CPU");
+        UnloadShader(m_shader);
+        m_shader = {};
+        return;
+    }
+    m_paletteSizeLoc = GetShaderLocation(m_shader, "paletteSize");
+    m_timeLoc = GetShaderLocation(m_shader, "time");
+    m_worldSizeLoc = GetShaderLocation(m_shader, "worldSize");
+
+    Color colors[PALETTE_SIZE] = {};
+    for (int i = 0; i < MATERIAL_COUNT; i++)
+    {
+        colors[i] = colorOf(static_cast<PixelType>(i));
+    }
+    Image image = {colors, PALETTE_SIZE, 1, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+    m_palette = LoadTextureFromImage(image);
+    SetTextureFilter(m_palette, TEXTURE_FILTER_POINT);
+
+    float paletteSize = PALETTE_SIZE;
+    SetShaderValue(m_shader, m_paletteSizeLoc, &paletteSize, SHADER_UNIFORM_FLOAT);
+}
+
+void Renderer::unload()
+{
+    if (m_texture.id != 0)
+        UnloadTexture(m_texture);
+    m_texture = {};
+
+    if (m_paletteLoc >= 0)
+    {
+        UnloadTexture(m_palette);
+        UnloadShader(m_shader);
+        m_palette = {};
+        m_shader = {};
+        m_paletteLoc = -1;
+    }
+}
+
+void Renderer::draw(const PixelView &view, const std::vector<DirtyRect> &changed, Vector2 offset)
 {
-    for (int y = 0; y < world.height(); y++)
+    PROFILE_SCOPE("renderer.draw");
+    if (m_texture.id == 0 || m_texture.width != view.width || m_texture.height != view.height)
     {
-        for (int x = 0; x < world.width(); x++)
+        createTexture(view);
+    }
+    else
+    {
+        int area = 0;
+        for (const DirtyRect &rect : changed)
+        {
+            area += (rect.maxX - rect.minX + 1) * (rect.maxY - rect.minY + 1);
+        }
+
+        // Past half the world one full upload beats many small ones
+        bool fullUpload = area * 2 > view.width * view.height;
+        if (usesGpuPalette())
         {
-            const Pixel &p = world.data()[y * world.width() + x];
-            Color c = BLACK;
-            switch (p.type)
+            if (fullUpload)
             {
-            case PixelType::SAND:
-                c = {200, 180, 50, 255};
-                break;
-            case PixelType::WATER:
-                c = {50, 100, 220, 255};
-                break;
-            case PixelType::STONE:
-                c = {120, 120, 120, 255};
-                break;
-            case PixelType::FIRE:
-                c = {255, 80, 20, 255};
-                break;
-            case PixelType::OIL:
-                c = {30, 30, 30, 255};
-                break;
-            default:
-                break;
+                UpdateTexture(m_texture, view.types);
+                PROFILE_COUNT(TEXTURE_UPLOADS, 1);
             }
-            if (p.type != PixelType::EMPTY)
+            else
+            {
+                for (const DirtyRect &rect : changed)
+                    uploadRect(m_texture, reinterpret_cast<const uint8_t *>(view.types), rect, m_idScratch);
+            }
+        }
+        else
+        {
+            for (const DirtyRect &rect : changed)
+                colorize(view, rect);
+
+            if (fullUpload)
             {
-                if (p.type == PixelType::FIRE)
-                {
-                    c.r = GetRandomValue(100, 200);
-                    c.g = GetRandomValue(40, 80);
-                    c.b = GetRandomValue(10, 20);
-                }
-                DrawRectangle(x * m_scale, y * m_scale, m_scale, m_scale, c);
+                UpdateTexture(m_texture, m_framebuffer.data());
+                PROFILE_COUNT(TEXTURE_UPLOADS, 1);
             }
+            else
+            {
+                for (const DirtyRect &rect : changed)
+                    uploadRect(m_texture, m_framebuffer.data(), rect, m_colorScratch);
+            }
+        }
+    }
+
+    Vector2 position = {offset.x * m_scale, offset.y * m_scale};
+    PROFILE_COUNT(DRAW_CALLS, 1);
+    if (usesGpuPalette())
+    {
+        float time = static_cast<float>(std::fmod(GetTime(), SHADER_TIME_PERIOD));
+        float worldSize[2] = {static_cast<float>(view.width), static_cast<float>(view.height)};
+        BeginShaderMode(m_shader);
+        SetShaderValue(m_shader, m_timeLoc, &time, SHADER_UNIFORM_FLOAT);
+        SetShaderValue(m_shader, m_worldSizeLoc, worldSize, SHADER_UNIFORM_VEC2);
+        SetShaderValueTexture(m_shader, m_paletteLoc, m_palette);
+        DrawTextureEx(m_texture, position, 0.0f, static_cast<float>(m_scale), WHITE);
+        EndShaderMode();
+    }
+    else
+    {
+        DrawTextureEx(m_texture, position, 0.0f, static_cast<float>(m_scale), WHITE);
+    }
+}
+
+void Renderer::drawParticles(const std::vector<ParticleSprite> &particles, Vector2 offset)
+{
+    PROFILE_SCOPE("renderer.particles");
+    uint32_t frame = flickerFrame();
+    for (const ParticleSprite &p : particles)
+    {
+        DrawRectangle(static_cast<int>((p.x + offset.x) * m_scale), static_cast<int>((p.y + offset.y) * m_scale),
+                      m_scale, m_scale, cellColor(p.type, p.x, p.y, frame));
+    }
+}
+
+void Renderer::createTexture(const PixelView &view)
+{
+    if (m_texture.id != 0)
+        UnloadTexture(m_texture);
+
+    Image image = {};
+    if (usesGpuPalette())
+    {
+        // One byte per cell, the material plane is uploaded as is
+        image = {const_cast<PixelType *>(view.types), view.width, view.height, 1, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE};
+    }
+    else
+    {
+        m_framebuffer.assign(view.width * view.height, BLANK);
+        DirtyRect all;
+        all.include(0, 0, view.width - 1, view.height - 1);
+        colorize(view, all);
+        image = {m_framebuffer.data(), view.width, view.height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+    }
+    m_texture = LoadTextureFromImage(image);
+    PROFILE_COUNT(TEXTURE_UPLOADS, 1);
+
+    // Material IDs must never be interpolated
+    SetTextureFilter(m_texture, TEXTURE_FILTER_POINT);
+}
+
+void Renderer::colorize(const PixelView &view, const DirtyRect &rect)
+{
+    uint32_t frame = flickerFrame();
+    for (int y = rect.minY; y <= rect.maxY; y++)
+    {
+        const PixelType *types = view.types + y * view.width;
+        Color *row = m_framebuffer.data() + y * view.width;
+        for (int x = rect.minX; x <= rect.maxX; x++)
+        {
+            row[x] = cellColor(types[x], x, y, frame);
         }
     }
 }
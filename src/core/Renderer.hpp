@@ -1,13 +1,43 @@
 #pragma once
 #include "PixelWorld.hpp"
+#include <cstdint>
+#include <vector>
+#include <raylib.h>
 
+// Draws the world as one scaled texture, re-uploading only the regions that changed.
+// With the pixel_world shader the texture holds raw material IDs and the GPU applies the
+// palette; without it the CPU colours an RGBA texture.
 class Renderer
 {
 public:
     Renderer(int scale) : m_scale(scale) {}
-    void draw(const PixelWorld &world);
+    // offset is where the view's top left cell lands on screen, in cells
+    void draw(const PixelView &view, const std::vector<DirtyRect> &changed, Vector2 offset = {0, 0});
+    // Draws cells in flight over the world, one scaled square each
+    void drawParticles(const std::vector<ParticleSprite> &particles, Vector2 offset = {0, 0});
     void setScale(int scale) { m_scale = scale; }
 
+    // Loads the palette shader, must run after the window opens
+    void load();
+    // Frees GPU resources, must run before the window closes
+    void unload();
+
+    bool usesGpuPalette() const { return m_paletteLoc >= 0; }
+
 private:
+    void createTexture(const PixelView &view);
+    void colorize(const PixelView &view, const DirtyRect &rect);
+
     int m_scale;
+    Texture2D m_texture{};
+    std::vector<Color> m_framebuffer; // CPU copy of the texture (CPU colouring only)
+    std::vector<Color> m_colorScratch;
+    std::vector<uint8_t> m_idScratch;
+
+    Shader m_shader{};
+    Texture2D m_palette{};
+    int m_paletteLoc = -1;
+    int m_paletteSizeLoc = -1;
+    int m_timeLoc = -1;
+    int m_worldSizeLoc = -1;
 };
@@ -0,0 +1,85 @@
+#pragma once
+#include "Materials.hpp"
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// Class bits per material, looked up 16 or 32 cells at a time with a byte shuffle
+constexpr uint8_t CLASS_FALLING = 1 << 0;
+constexpr uint8_t CLASS_FIRE = 1 << 1;
+constexpr uint8_t CLASS_LIQUID = 1 << 2;
+
+static_assert(MATERIAL_COUNT <= 16, "row classes are looked up in a 16-byte shuffle table");
+
+struct RowClasses
+{
+    alignas(16) uint8_t bits[16];
+};
+
+constexpr RowClasses makeRowClasses()
+{
+    RowClasses classes{};
+    for (int i = 0; i < MATERIAL_COUNT; i++)
+    {
+        PixelType type = static_cast<PixelType>(i);
+        classes.bits[i] = static_cast<uint8_t>((isFalling(type) ? CLASS_FALLING : 0) |
+                                               (type == PixelType::FIRE ? CLASS_FIRE : 0) |
+                                               (materialTraits(type).kind == MoveKind::LIQUID ? CLASS_LIQUID : 0));
+    }
+    return classes;
+}
+
+constexpr RowClasses ROW_CLASSES = makeRowClasses();
+
+// Bit i of the result is set when types[i] belongs to one of the wanted classes, count <= 64
+inline uint64_t classifyRow(const PixelType *types, int count, uint8_t wanted)
+{
+    const uint8_t *t = reinterpret_cast<const uint8_t *>(types);
+    uint64_t mask = 0;
+    int i = 0;
+
+#if defined(__AVX2__)
+    // vpshufb looks up within each 128-bit lane, so the table is repeated in both
+    __m256i lut = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(ROW_CLASSES.bits)));
+    __m256i want = _mm256_set1_epi8(static_cast<char>(wanted));
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(t + i));
+        __m256i hit = _mm256_and_si256(_mm256_shuffle_epi8(lut, v), want);
+        uint32_t miss = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, _mm256_setzero_si256())));
+        mask |= static_cast<uint64_t>(~miss) << i;
+    }
+#endif
+#if defined(__SSSE3__)
+    __m128i lut16 = _mm_load_si128(reinterpret_cast<const __m128i *>(ROW_CLASSES.bits));
+    __m128i want16 = _mm_set1_epi8(static_cast<char>(wanted));
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + i));
+        __m128i hit = _mm_and_si128(_mm_shuffle_epi8(lut16, v), want16);
+        uint32_t miss = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())));
+        mask |= static_cast<uint64_t>(~miss & 0xFFFF) << i;
+    }
+#elif defined(__wasm_simd128__)
+    v128_t lut16 = wasm_v128_load(ROW_CLASSES.bits);
+    v128_t want16 = wasm_i8x16_splat(static_cast<int8_t>(wanted));
+    for (; i + 16 <= count; i += 16)
+    {
+        v128_t v = wasm_v128_load(t + i);
+        v128_t hit = wasm_v128_and(wasm_i8x16_swizzle(lut16, v), want16);
+        uint32_t miss = wasm_i8x16_bitmask(wasm_i8x16_eq(hit, wasm_i8x16_splat(0)));
+        mask |= static_cast<uint64_t>(~miss & 0xFFFF) << i;
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        if (ROW_CLASSES.bits[t[i]] & wanted)
+            mask |= 1ull << i;
+    }
+    return mask;
+}
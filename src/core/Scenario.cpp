@@ -0,0 +1,164 @@
+#include "Scenario.hpp"
+#include <algorithm>
+
+void fillRect(PixelWorld &world, int x0, int y0, int x1, int y1, PixelType type)
+{
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    EditBuffer edits;
+    edits.fillRect(x0, y0, x1 - 1, y1 - 1, type);
+    world.applyEdits(edits);
+}
+
+// Drops a cell in at x,y unless something is already there, so streams never erase what they land on
+static void pour(PixelWorld &world, int x, int y, PixelType type)
+{
+    if (world.data().types[y * world.width() + x] == PixelType::EMPTY)
+        world.addPixel(x, y, type);
+}
+
+static void stoneFloor(PixelWorld &world)
+{
+    fillRect(world, 0, world.height() - 2, world.width(), world.height(), PixelType::STONE);
+}
+
+// A sand block collapsing onto a stone ramp
+static void setupSandAvalanche(PixelWorld &world)
+{
+    int w = world.width(), h = world.height();
+    stoneFloor(world);
+    for (int x = 0; x < w / 2; x++)
+    {
+        int top = h - 2 - (w / 2 - x) * h / (2 * w);
+        fillRect(world, x, top, x + 1, h - 2, PixelType::STONE);
+    }
+    fillRect(world, w / 8, 0, w / 2, h / 3, PixelType::SAND);
+}
+
+// A stone tank with a column of water dropped into one side
+static void setupWaterTank(PixelWorld &world)
+{
+    int w = world.width(), h = world.height();
+    stoneFloor(world);
+    fillRect(world, w / 8, h / 4, w / 8 + 2, h - 2, PixelType::STONE);
+    fillRect(world, w * 7 / 8 - 2, h / 4, w * 7 / 8, h - 2, PixelType::STONE);
+    fillRect(world, w / 8 + 2, 0, w * 3 / 8, h * 2 / 3, PixelType::WATER);
+}
+
+// An oil slick on water, lit along its surface
+static void setupOilFire(PixelWorld &world)
+{
+    int w = world.width(), h = world.height();
+    stoneFloor(world);
+    fillRect(world, 0, h * 3 / 4, w, h - 2, PixelType::WATER);
+    fillRect(world, 0, h * 5 / 8, w, h * 3 / 4, PixelType::OIL);
+    fillRect(world, w / 2 - 8, h * 5 / 8 - 2, w / 2 + 8, h * 5 / 8, PixelType::FIRE);
+}
+
+// A deep oil pool stirred by a stream poured into it, with no flame anywhere
+static void setupOilPool(PixelWorld &world)
+{
+    int w = world.width(), h = world.height();
+    stoneFloor(world);
+    fillRect(world, 0, h / 3, w, h - 2, PixelType::OIL);
+}
+
+static void tickOilPool(PixelWorld &world, int)
+{
+    pour(world, world.width() / 2, 0, PixelType::OIL);
+}
+
+// A settled landscape with a thin sand stream, most of the grid never moves
+static void setupMostlyStatic(PixelWorld &world)
+{
+    int w = world.width(), h = world.height();
+    stoneFloor(world);
+    fillRect(world, 0, h / 2, w, h - 2, PixelType::SAND);
+    fillRect(world, w / 3, h / 3, w * 2 / 3, h / 2, PixelType::STONE);
+}
+
+static void tickMostlyStatic(PixelWorld &world, int)
+{
+    pour(world, world.width() / 5, 0, PixelType::SAND);
+}
+
+// Sand and water noise over the whole world. Whatever lands on the bottom row is put back
+// on top, so the grid keeps moving instead of settling.
+static void setupChurn(PixelWorld &world)
+{
+    Random &rng = world.random();
+    for (int y = 0; y < world.height(); y++)
+    {
+        for (int x = 0; x < world.width(); x++)
+        {
+            int r = rng.range(0, 3);
+            if (r < 2)
+                world.addPixel(x, y, r == 0 ? PixelType::SAND : PixelType::WATER);
+        }
+    }
+}
+
+static void tickChurn(PixelWorld &world, int)
+{
+    const PixelType *types = world.data().types;
+    int bottom = world.height() - 1;
+    for (int x = 0; x < world.width(); x++)
+    {
+        PixelType type = types[bottom * world.width() + x];
+        if (type != PixelType::EMPTY && types[x] == PixelType::EMPTY)
+        {
+            world.addPixel(x, 0, type);
+            world.addPixel(x, bottom, PixelType::EMPTY);
+        }
+    }
+}
+
+// Stone pillars standing in a water pool, blasted one after another while sand pours from
+// the top of the world, so debris, splashes and long falls all fly as particles
+static void setupDemolition(PixelWorld &world)
+{
+    int w = world.width(), h = world.height();
+    stoneFloor(world);
+    fillRect(world, 0, h * 3 / 4, w, h - 2, PixelType::WATER);
+    for (int x = w / 8; x < w; x += w / 4)
+        fillRect(world, x - 6, h / 3, x + 6, h * 3 / 4, PixelType::STONE);
+}
+
+static void tickDemolition(PixelWorld &world, int step)
+{
+    int w = world.width(), h = world.height();
+    for (int x = w / 4; x < w; x += w / 4)
+        pour(world, x, 0, PixelType::SAND);
+    if (step % 60 == 0)
+    {
+        EditBuffer edits;
+        int pillar = (step / 60) % 4;
+        int y = h / 3 + (step / 240) % 4 * h / 10;
+        edits.explode(world.originX() + w / 8 + pillar * (w / 4), world.originY() + y, std::max(w / 40, 4));
+        world.applyEdits(edits);
+    }
+}
+
+const std::vector<Scenario> &builtinScenarios()
+{
+    static const std::vector<Scenario> scenarios = {
+        {"sand_avalanche", "sand block collapsing onto a stone ramp", setupSandAvalanche, nullptr},
+        {"water_tank", "water column settling in a stone tank", setupWaterTank, nullptr},
+        {"oil_fire", "burning oil slick floating on water", setupOilFire, nullptr},
+        {"oil_pool", "unlit oil pool with a stream pouring in", setupOilPool, tickOilPool},
+        {"mostly_static", "settled sand world with a thin sand stream", setupMostlyStatic, tickMostlyStatic},
+        {"churn", "full-screen sand and water that never settles", setupChurn, tickChurn},
+        {"demolition", "stone pillars in water blasted apart under falling sand", setupDemolition, tickDemolition},
+    };
+    return scenarios;
+}
+
+const Scenario *findScenario(const std::string &name)
+{
+    for (const Scenario &scenario : builtinScenarios())
+    {
+        if (name == scenario.name)
+            return &scenario;
+    }
+    return nullptr;
+}
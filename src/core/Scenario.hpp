@@ -0,0 +1,19 @@
+#pragma once
+#include "PixelWorld.hpp"
+#include <string>
+#include <vector>
+
+// Scripted world setup shared by the headless tools, sized to whatever world it is given
+struct Scenario
+{
+    const char *name;
+    const char *description;
+    void (*setup)(PixelWorld &world);
+    void (*tick)(PixelWorld &world, int step); // optional per-step driver, may be null
+};
+
+const std::vector<Scenario> &builtinScenarios();
+const Scenario *findScenario(const std::string &name);
+
+// Fills the half-open rectangle x0..x1-1, y0..y1-1 in one edit, the way scenarios set up
+void fillRect(PixelWorld &world, int x0, int y0, int x1, int y1, PixelType type);
@@ -0,0 +1,416 @@
+#include "Simulation.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+
+// Single-threaded WebAssembly has no threads, the frame loop pumps the ticks there
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define SIMULATION_INLINE_TICKS
+#endif
+
+// Falling further behind than this drops the lost time instead of trying to catch up
+static const int MAX_CATCHUP_TICKS = 4;
+
+Simulation::Simulation(int width, int height, uint64_t seed)
+    : m_width(width), m_height(height), m_world(width, height, seed),
+      m_unread(m_world.chunkCount())
+{
+    // Every slot starts as the empty world so the reader always has something to draw
+    for (SimFrame &slot : m_slots)
+    {
+        m_world.copyFrame(slot.world);
+        slot.chunkCount = m_world.chunkCount();
+    }
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::enableStreaming(StreamSettings settings)
+{
+    m_stream = std::move(settings);
+    m_store = std::make_unique<ChunkStore>(m_stream.directory, m_stream.residentChunks, m_stream.generate);
+}
+
+void Simulation::setCamera(int x, int y)
+{
+    m_cameraX.store(x, std::memory_order_relaxed);
+    m_cameraY.store(y, std::memory_order_relaxed);
+}
+
+void Simulation::setFocus(int x, int y)
+{
+    m_focusX.store(x, std::memory_order_relaxed);
+    m_focusY.store(y, std::memory_order_relaxed);
+}
+
+void Simulation::checkpoint()
+{
+    if (!m_store)
+        return;
+    submit([this](PixelWorld &)
+           {
+               storeWindow();
+               m_store->flush(false);
+           });
+}
+
+void Simulation::start()
+{
+    if (m_started)
+        return;
+    // The first window is paged in before anything is published
+    if (m_store)
+        followCamera();
+    m_started = true;
+    m_stopping = false;
+    m_nextTick = Clock::now();
+#ifndef SIMULATION_INLINE_TICKS
+    m_thread = std::thread(&Simulation::threadLoop, this);
+#endif
+}
+
+void Simulation::stop()
+{
+    bool wasStarted = m_started;
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+    m_started = false;
+
+    // Streamed worlds persist through the store, so the window has to reach the disk too
+    if (wasStarted && m_store)
+    {
+        storeWindow();
+        m_store->flush(true);
+    }
+}
+
+void Simulation::pump()
+{
+#ifdef SIMULATION_INLINE_TICKS
+    if (m_started)
+        runDueTicks(Clock::now());
+#endif
+}
+
+void Simulation::submit(std::function<void(PixelWorld &)> edit)
+{
+    std::lock_guard<std::mutex> lock(m_editMutex);
+    m_edits.push_back(std::move(edit));
+}
+
+void Simulation::rewind(int ticks)
+{
+    // Counted here so rewinding() holds edits back from this call on, not from the next frame
+    if (ticks < 0)
+        m_rewindSteps.fetch_add(1, std::memory_order_acq_rel);
+    submit([this, ticks](PixelWorld &)
+           {
+               stepRewind(ticks);
+               if (ticks < 0)
+                   m_rewindSteps.fetch_sub(1, std::memory_order_acq_rel);
+           });
+}
+
+void Simulation::resume()
+{
+    submit([this](PixelWorld &world)
+           {
+               if (!m_rewinding)
+                   return;
+               world.loadFrame(m_rewindFrame);
+               m_history.truncate(m_rewindTick);
+               m_tick = m_rewindTick;
+               setRewinding(false);
+           });
+}
+
+void Simulation::stepRewind(int ticks)
+{
+    if (!m_rewinding)
+    {
+        // Steps forward only move through a rewind
+        if (m_history.empty() || ticks >= 0)
+            return;
+        setRewinding(true);
+        m_rewindTick = m_history.newestTick();
+    }
+
+    // The live world carries on meanwhile, stepping past it goes back to it
+    int64_t target = static_cast<int64_t>(m_rewindTick) + ticks;
+    if (ticks > 0 && target > static_cast<int64_t>(m_history.newestTick()))
+    {
+        setRewinding(false);
+        markAllChanged();
+        publish(0.0f);
+        return;
+    }
+    // The oldest ticks can go while the live world records new ones
+    m_rewindTick = static_cast<uint64_t>(std::clamp(target, static_cast<int64_t>(m_history.oldestTick()),
+                                                    static_cast<int64_t>(m_history.newestTick())));
+    {
+        PROFILE_SCOPE("sim.rewind");
+        m_history.reconstruct(m_rewindTick, m_rewindFrame);
+    }
+    markAllChanged();
+    publish(0.0f);
+}
+
+void Simulation::setRewinding(bool rewinding)
+{
+    m_rewinding = rewinding;
+    m_rewindShown.store(rewinding, std::memory_order_release);
+}
+
+void Simulation::markAllChanged()
+{
+    constexpr int C = PixelWorld::CHUNK_SIZE;
+    for (int cy = 0; cy < m_world.chunksY(); cy++)
+    {
+        for (int cx = 0; cx < m_world.chunksX(); cx++)
+        {
+            DirtyRect &rect = m_tickRects.emplace_back();
+            rect.include(cx * C, cy * C, std::min((cx + 1) * C, m_width) - 1, std::min((cy + 1) * C, m_height) - 1);
+        }
+    }
+}
+
+void Simulation::setSpeed(int speed)
+{
+    m_speed.store(std::clamp(speed, 1, MAX_SPEED), std::memory_order_relaxed);
+}
+
+bool Simulation::acquireFrame()
+{
+    if (!(m_latest.load(std::memory_order_acquire) & FRESH))
+        return false;
+    m_front = m_latest.exchange(m_front, std::memory_order_acq_rel) & ~FRESH;
+    return true;
+}
+
+void Simulation::threadLoop()
+{
+    PROFILE_THREAD("simulation");
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    while (!m_stopping)
+    {
+        lock.unlock();
+        Clock::time_point next = runDueTicks(Clock::now());
+        lock.lock();
+        m_wake.wait_until(lock, next, [this] { return m_stopping; });
+    }
+}
+
+Simulation::Clock::time_point Simulation::runDueTicks(Clock::time_point now)
+{
+    const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / TICK_RATE));
+
+    int due = 0;
+    while (m_nextTick <= now && due < MAX_CATCHUP_TICKS)
+    {
+        m_nextTick += interval;
+        due++;
+    }
+    if (m_nextTick <= now)
+        m_nextTick = now + interval;
+    if (due == 0)
+        return m_nextTick;
+
+    // A rewind resumes into the window it was recorded in, so the window stays put meanwhile
+    if (m_store && !m_rewinding)
+    {
+        PROFILE_SCOPE("sim.stream");
+        int originX = m_world.originX(), originY = m_world.originY();
+        followCamera();
+        // Recorded ticks are of the old window
+        if (m_world.originX() != originX || m_world.originY() != originY)
+            m_history.clear();
+    }
+    applyEdits();
+
+    // Fast-forward runs more ticks of the same length, so it changes nothing but the pace
+    int ticks = due * m_speed.load(std::memory_order_relaxed);
+    m_world.setFocus(m_focusX.load(std::memory_order_relaxed), m_focusY.load(std::memory_order_relaxed));
+    auto start = Clock::now();
+    for (int i = 0; i < ticks; i++)
+    {
+        m_world.update(TICK_DT);
+        m_tick++;
+
+        // Changed rects hold at most one rect per chunk, each inside its chunk
+        m_world.takeChangedRects(m_stepRects);
+        {
+            PROFILE_SCOPE("sim.history");
+            m_history.record(m_world.data(), m_stepRects, m_tick);
+        }
+        // The reader sees the rewound frame, and gets the whole window back when the rewind ends
+        if (!m_rewinding)
+            m_tickRects.insert(m_tickRects.end(), m_stepRects.begin(), m_stepRects.end());
+    }
+    float updateMs = std::chrono::duration<float, std::milli>(Clock::now() - start).count() / ticks;
+
+    publish(updateMs);
+    return m_nextTick;
+}
+
+void Simulation::applyEdits()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_editMutex);
+        m_applying.swap(m_edits);
+    }
+    for (auto &edit : m_applying)
+        edit(m_world);
+    m_applying.clear();
+}
+
+void Simulation::publish(float updateMs)
+{
+    PROFILE_SCOPE("sim.publish");
+    const int chunksX = (m_width + PixelWorld::CHUNK_SIZE - 1) / PixelWorld::CHUNK_SIZE;
+    auto chunkOf = [&](const DirtyRect &rect)
+    {
+        return (rect.minY / PixelWorld::CHUNK_SIZE) * chunksX + rect.minX / PixelWorld::CHUNK_SIZE;
+    };
+    for (const DirtyRect &rect : m_tickRects)
+        m_unread[chunkOf(rect)].include(rect.minX, rect.minY, rect.maxX, rect.maxY);
+
+    SimFrame &slot = m_slots[m_back];
+    if (m_rewinding)
+    {
+        slot.world = m_rewindFrame;
+        slot.particles.clear();
+    }
+    else
+    {
+        m_world.copyFrame(slot.world);
+        m_world.particles().sprites(slot.particles);
+    }
+    slot.changed.clear();
+    for (const DirtyRect &rect : m_unread)
+    {
+        if (!rect.empty())
+            slot.changed.push_back(rect);
+    }
+    slot.tick = m_rewinding ? m_rewindTick : m_tick;
+    slot.updateMs = updateMs;
+    slot.activeChunks = m_world.activeChunkCount();
+    slot.chunkCount = m_world.chunkCount();
+    slot.mode = m_world.updateMode();
+    slot.threads = m_world.threadCount();
+    slot.originX = m_world.originX();
+    slot.originY = m_world.originY();
+    slot.residentChunks = m_store ? m_store->residentCount() : 0;
+    slot.savedChunks = m_store ? m_store->savedCount() : 0;
+    slot.rewinding = m_rewinding;
+    slot.historyFirst = m_history.empty() ? m_tick : m_history.oldestTick();
+    slot.historyLast = m_history.empty() ? m_tick : m_history.newestTick();
+    slot.deferredChunks = m_world.deferredChunkCount();
+    slot.maxDeferred = m_world.maxDeferredUpdates();
+
+    int previous = m_latest.exchange(m_back | FRESH, std::memory_order_acq_rel);
+    m_back = previous & ~FRESH;
+
+    // Once the reader has taken the previous frame, only this tick's changes are news to it.
+    // A frame it skipped keeps its changes queued for the next one.
+    if (!(previous & FRESH))
+    {
+        for (DirtyRect &rect : m_unread)
+            rect.reset();
+        for (const DirtyRect &rect : m_tickRects)
+            m_unread[chunkOf(rect)].include(rect.minX, rect.minY, rect.maxX, rect.maxY);
+    }
+    m_tickRects.clear();
+}
+
+void Simulation::followCamera()
+{
+    constexpr int C = PixelWorld::CHUNK_SIZE;
+    const int chunksX = m_world.chunksX(), chunksY = m_world.chunksY();
+    const int worldChunksX = m_stream.worldWidth / C, worldChunksY = m_stream.worldHeight / C;
+    auto floorDiv = [](int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); };
+
+    // Keep STREAM_MARGIN chunks around the view, but never look past the world's edge
+    int originCX = std::clamp(floorDiv(m_cameraX.load(std::memory_order_relaxed), C) - STREAM_MARGIN,
+                              0, std::max(worldChunksX - chunksX, 0));
+    int originCY = std::clamp(floorDiv(m_cameraY.load(std::memory_order_relaxed), C) - STREAM_MARGIN,
+                              0, std::max(worldChunksY - chunksY, 0));
+    int oldCX = m_world.originX() / C, oldCY = m_world.originY() / C;
+    if (m_windowLoaded && originCX == oldCX && originCY == oldCY)
+        return;
+
+    auto insideWorld = [&](int wcx, int wcy) { return wcx >= 0 && wcy >= 0 && wcx < worldChunksX && wcy < worldChunksY; };
+    auto insideWindow = [&](int wcx, int wcy, int ocx, int ocy)
+    {
+        return wcx >= ocx && wcy >= ocy && wcx < ocx + chunksX && wcy < ocy + chunksY;
+    };
+
+    if (m_windowLoaded)
+    {
+        for (int cy = 0; cy < chunksY; cy++)
+        {
+            for (int cx = 0; cx < chunksX; cx++)
+            {
+                int wcx = oldCX + cx, wcy = oldCY + cy;
+                if (insideWorld(wcx, wcy) && !insideWindow(wcx, wcy, originCX, originCY))
+                {
+                    m_world.copyChunk(cx, cy, m_chunkScratch);
+                    m_store->put(wcx, wcy, m_chunkScratch);
+                }
+            }
+        }
+    }
+
+    m_world.moveOrigin(originCX * C, originCY * C);
+    for (int cy = 0; cy < chunksY; cy++)
+    {
+        for (int cx = 0; cx < chunksX; cx++)
+        {
+            int wcx = originCX + cx, wcy = originCY + cy;
+            if (insideWorld(wcx, wcy) && (!m_windowLoaded || !insideWindow(wcx, wcy, oldCX, oldCY)))
+            {
+                m_store->take(wcx, wcy, m_chunkScratch);
+                m_world.loadChunk(cx, cy, m_chunkScratch);
+            }
+        }
+    }
+    m_windowLoaded = true;
+
+    // The ring just outside the window is what the next move needs
+    for (int cy = -1; cy <= chunksY; cy++)
+    {
+        for (int cx = -1; cx <= chunksX; cx++)
+        {
+            bool ring = cx < 0 || cy < 0 || cx == chunksX || cy == chunksY;
+            if (ring && insideWorld(originCX + cx, originCY + cy))
+                m_store->prefetch(originCX + cx, originCY + cy);
+        }
+    }
+    m_store->trim();
+}
+
+void Simulation::storeWindow()
+{
+    if (!m_windowLoaded)
+        return;
+    constexpr int C = PixelWorld::CHUNK_SIZE;
+    const int originCX = m_world.originX() / C, originCY = m_world.originY() / C;
+    for (int cy = 0; cy < m_world.chunksY(); cy++)
+    {
+        for (int cx = 0; cx < m_world.chunksX(); cx++)
+        {
+            int wcx = originCX + cx, wcy = originCY + cy;
+            if (wcx < m_stream.worldWidth / C && wcy < m_stream.worldHeight / C)
+            {
+                m_world.copyChunk(cx, cy, m_chunkScratch);
+                m_store->put(wcx, wcy, m_chunkScratch);
+            }
+        }
+    }
+}
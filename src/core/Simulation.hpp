@@ -0,0 +1,186 @@
+#pragma once
+#include "ChunkStore.hpp"
+#include "History.hpp"
+#include "PixelWorld.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What the simulation looked like after a tick, as handed to the renderer
+struct SimFrame
+{
+    WorldFrame world;
+    std::vector<DirtyRect> changed; // everything changed since the last frame the reader took
+    std::vector<ParticleSprite> particles; // cells in flight, drawn over the world
+    uint64_t tick = 0;
+    float updateMs = 0.0f; // mean world update time over the ticks behind this frame
+    int activeChunks = 0, chunkCount = 0;
+    UpdateMode mode = UpdateMode::SERIAL;
+    int threads = 1;
+    int originX = 0, originY = 0;        // world cell at the frame's top left
+    int residentChunks = 0, savedChunks = 0; // streamed worlds only
+    bool rewinding = false;                  // world is a recorded tick, the live one runs on unseen
+    uint64_t historyFirst = 0, historyLast = 0; // recorded ticks, equal when none are
+    int deferredChunks = 0, maxDeferred = 0;    // held back by the update budget, see PixelWorld
+};
+
+// A world larger than the simulated grid, paged through a ChunkStore
+struct StreamSettings
+{
+    int worldWidth = 0, worldHeight = 0; // in cells, the camera never leaves them
+    std::string directory;               // chunk files, kept between sessions
+    int residentChunks = 2048;           // chunks held in memory besides the grid's own
+    ChunkStore::Generator generate;      // fills chunks that were never saved, may be null
+};
+
+// Runs a PixelWorld at a fixed tick rate on its own thread. Edits are queued and applied
+// between ticks, finished ticks are published through a triple buffer so the render thread
+// never waits on the simulation. Without threads (single-threaded WebAssembly) the ticks run
+// inline from pump() instead.
+//
+// Every tick is recorded into a WorldHistory. Rewinding publishes recorded ticks rebuilt on
+// the simulation thread while the live world keeps ticking, and the window stops following
+// the camera until it ends. Resuming carries on from the tick shown, stepping past the
+// newest tick goes back to the live world.
+//
+// With streaming on, the PixelWorld is a window onto a larger world that follows the camera
+// a chunk at a time. Chunks leaving the window go to a ChunkStore, chunks around it are
+// prefetched so the window rarely waits on disk.
+class Simulation
+{
+public:
+    static constexpr int TICK_RATE = 60;
+    static constexpr float TICK_DT = 1.0f / TICK_RATE;
+    static constexpr int MAX_SPEED = 8;
+    // Chunks the window reaches past the camera's view on every side
+    static constexpr int STREAM_MARGIN = 1;
+
+    // Grid size that covers a view of viewCells plus the streaming margin
+    static constexpr int streamWindowCells(int viewCells)
+    {
+        constexpr int C = PixelWorld::CHUNK_SIZE;
+        return ((viewCells + C - 1) / C + 2 * STREAM_MARGIN) * C;
+    }
+
+    Simulation(int width, int height, uint64_t seed = 0);
+    ~Simulation();
+
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    void start();
+    void stop();
+    // Runs the ticks that are due when there is no simulation thread, does nothing otherwise
+    void pump();
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // Makes the grid a window onto a larger streamed world, call before start()
+    void enableStreaming(StreamSettings settings);
+    bool streaming() const { return m_store != nullptr; }
+    // World cell at the top left of the view, the window follows it from the next tick
+    void setCamera(int x, int y);
+    // World cell budgeted updates favour, such as the cursor, from the next tick on
+    void setFocus(int x, int y);
+    // Queues the window's chunks for writing without waiting for the disk
+    void checkpoint();
+
+    // Queues an edit, applied on the simulation thread before the next tick
+    void submit(std::function<void(PixelWorld &)> edit);
+    // Queues cell edits, applied as span writes at the start of the next tick
+    void queueEdits(const EditBuffer &edits) { m_world.queueEdits(edits); }
+
+    // Fast-forward: ticks run per 1/TICK_RATE seconds, 1 to MAX_SPEED
+    void setSpeed(int speed);
+    int speed() const { return m_speed.load(std::memory_order_relaxed); }
+
+    // Steps through the recorded ticks, negative goes back. The first step back starts at the
+    // newest one, a step forward past the newest returns to the live world.
+    void rewind(int ticks);
+    // Carries on from the tick rewind() shows, forgetting the ticks after it
+    void resume();
+    // True from the first step back until the rewind ends. World edits made meanwhile would
+    // land on the live world, which resume() replaces, so callers hold them back.
+    bool rewinding() const
+    {
+        return m_rewindShown.load(std::memory_order_acquire) || m_rewindSteps.load(std::memory_order_acquire) > 0;
+    }
+
+    // Copies the live world, never a rewound tick, for saving. Only once stop() has returned,
+    // the simulation thread owns the world until then.
+    void copyWorld(WorldFrame &frame) const { m_world.copyFrame(frame); }
+
+    // Takes the newest published frame if there is one, true when frame() changed.
+    // Render thread only; frame() stays valid until the next call.
+    bool acquireFrame();
+    const SimFrame &frame() const { return m_slots[m_front]; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Bit set in m_latest while the slot it names hasn't been taken by the reader
+    static constexpr int FRESH = 4;
+
+    void threadLoop();
+    // Runs whatever ticks are due at now and publishes the result, returns when the next one is due
+    Clock::time_point runDueTicks(Clock::time_point now);
+    void applyEdits();
+    void publish(float updateMs);
+    // Shows recorded tick m_rewindTick plus ticks, clamped to what is held
+    void stepRewind(int ticks);
+    // Sets m_rewinding, and the flag rewinding() reads with it
+    void setRewinding(bool rewinding);
+    // Queues every chunk of the window for the reader, for a frame that can differ anywhere
+    void markAllChanged();
+    // Moves the window to wherever the camera needs it, paging chunks out and in
+    void followCamera();
+    // Hands every chunk of the window to the store, which keeps its own copy
+    void storeWindow();
+
+    int m_width, m_height;
+    PixelWorld m_world;
+
+    std::mutex m_editMutex;
+    std::vector<std::function<void(PixelWorld &)>> m_edits;
+    std::vector<std::function<void(PixelWorld &)>> m_applying;
+
+    SimFrame m_slots[3];
+    int m_front = 0;            // reader's slot
+    int m_back = 1;             // writer's slot
+    std::atomic<int> m_latest{2}; // last published slot, plus FRESH
+    std::vector<DirtyRect> m_tickRects;  // changed since the last publish, maybe several per chunk
+    std::vector<DirtyRect> m_stepRects;  // changed by one tick
+    std::vector<DirtyRect> m_unread; // per chunk, changes since the last frame the reader took
+
+    StreamSettings m_stream;
+    std::unique_ptr<ChunkStore> m_store;
+    bool m_windowLoaded = false;
+    std::atomic<int> m_cameraX{0}, m_cameraY{0};
+    std::atomic<int> m_focusX{0}, m_focusY{0};
+    ChunkCells m_chunkScratch;
+
+    WorldHistory m_history;
+    bool m_rewinding = false;
+    std::atomic<bool> m_rewindShown{false};
+    std::atomic<int> m_rewindSteps{0}; // steps back queued but not yet shown
+    uint64_t m_rewindTick = 0;
+    WorldFrame m_rewindFrame;
+
+    std::atomic<int> m_speed{1};
+    uint64_t m_tick = 0;
+    Clock::time_point m_nextTick;
+    bool m_started = false;
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,275 @@
+#include "Snapshot.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+// Threads are unavailable in single-threaded WebAssembly builds, saves happen inline there
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define SNAPSHOT_INLINE_WRITES
+#endif
+
+static const char SNAPSHOT_MAGIC[4] = {'P', 'X', 'W', 'S'};
+
+static void putU32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+// Bounds-checked reader, any overrun marks it failed
+struct SnapshotReader
+{
+    const uint8_t *data;
+    size_t size;
+    size_t pos = 0;
+    bool failed = false;
+
+    uint8_t u8()
+    {
+        if (pos >= size)
+        {
+            failed = true;
+            return 0;
+        }
+        return data[pos++];
+    }
+    uint16_t u16()
+    {
+        uint16_t lo = u8();
+        return static_cast<uint16_t>(lo | (u8() << 8));
+    }
+    uint32_t u32()
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++)
+            v |= static_cast<uint32_t>(u8()) << (8 * i);
+        return v;
+    }
+    uint32_t varint()
+    {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            uint8_t b = u8();
+            v |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+        failed = true;
+        return 0;
+    }
+};
+
+void encodeSnapshot(const WorldFrame &frame, std::vector<uint8_t> &out)
+{
+    const int count = frame.width * frame.height;
+    std::vector<uint8_t> runs;
+    std::vector<uint8_t> values;
+    uint32_t runCount = 0;
+    uint32_t valueCount = 0;
+
+    for (int i = 0; i < count;)
+    {
+        PixelType type = frame.types[i];
+        int end = i + 1;
+        while (end < count && frame.types[end] == type)
+            end++;
+
+        runs.push_back(static_cast<uint8_t>(type));
+        putVarint(runs, static_cast<uint32_t>(end - i));
+        runCount++;
+        i = end;
+    }
+
+    int last = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (frame.values[i] == 0 || !valueMatters(frame.types[i]))
+            continue;
+        putVarint(values, static_cast<uint32_t>(i - last));
+        values.push_back(static_cast<uint8_t>(frame.values[i]));
+        values.push_back(static_cast<uint8_t>(frame.values[i] >> 8));
+        valueCount++;
+        last = i;
+    }
+
+    out.clear();
+    out.reserve(24 + runs.size() + values.size());
+    out.insert(out.end(), SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 4);
+    putU32(out, SNAPSHOT_VERSION);
+    putU32(out, static_cast<uint32_t>(frame.width));
+    putU32(out, static_cast<uint32_t>(frame.height));
+    putU32(out, runCount);
+    putU32(out, valueCount);
+    out.insert(out.end(), runs.begin(), runs.end());
+    out.insert(out.end(), values.begin(), values.end());
+}
+
+bool decodeSnapshot(const uint8_t *data, size_t size, WorldFrame &frame)
+{
+    if (size < 24 || memcmp(data, SNAPSHOT_MAGIC, 4) != 0)
+        return false;
+
+    SnapshotReader in{data, size, 4};
+    if (in.u32() != SNAPSHOT_VERSION)
+        return false;
+
+    uint32_t width = in.u32();
+    uint32_t height = in.u32();
+    uint32_t runCount = in.u32();
+    uint32_t valueCount = in.u32();
+    if (width == 0 || height == 0 || width > 65536 || height > 65536)
+        return false;
+
+    // A run takes at least two bytes and a value three, so a header claiming more than the
+    // payload holds is refused before anything is allocated
+    const size_t count = static_cast<size_t>(width) * height;
+    if (count > SNAPSHOT_MAX_CELLS || runCount > count || valueCount > count ||
+        2 * static_cast<uint64_t>(runCount) + 3 * static_cast<uint64_t>(valueCount) > size - in.pos)
+        return false;
+
+    // The runs have to cover the frame exactly, checked in a first walk over them
+    const size_t runsStart = in.pos;
+    size_t filled = 0;
+    for (uint32_t r = 0; r < runCount && !in.failed; r++)
+    {
+        uint8_t type = in.u8();
+        uint32_t length = in.varint();
+        if (type >= MATERIAL_COUNT || length > count - filled)
+            return false;
+        filled += length;
+    }
+    if (in.failed || filled != count)
+        return false;
+
+    frame.width = static_cast<int>(width);
+    frame.height = static_cast<int>(height);
+    frame.types.resize(count);
+    frame.values.assign(count, 0);
+
+    in.pos = runsStart;
+    filled = 0;
+    for (uint32_t r = 0; r < runCount; r++)
+    {
+        auto type = static_cast<PixelType>(in.u8());
+        uint32_t length = in.varint();
+        std::fill_n(frame.types.begin() + filled, length, type);
+        filled += length;
+    }
+
+    size_t index = 0;
+    for (uint32_t v = 0; v < valueCount && !in.failed; v++)
+    {
+        index += in.varint();
+        uint16_t value = in.u16();
+        if (index >= count)
+            return false;
+        frame.values[index] = value;
+    }
+    return !in.failed;
+}
+
+bool saveSnapshot(const std::string &path, const WorldFrame &frame)
+{
+    std::vector<uint8_t> bytes;
+    encodeSnapshot(frame, bytes);
+
+    // Write next to the target and rename, so a crash never leaves half a snapshot behind
+    std::string tmpPath = path + ".tmp";
+    FILE *f = fopen(tmpPath.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    ok = fclose(f) == 0 && ok;
+
+    std::error_code error;
+    if (ok)
+        std::filesystem::rename(tmpPath, path, error);
+    if (!ok || error)
+    {
+        std::filesystem::remove(tmpPath, error);
+        return false;
+    }
+    return true;
+}
+
+bool loadSnapshot(const std::string &path, WorldFrame &frame)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    fclose(f);
+
+    return decodeSnapshot(bytes.data(), bytes.size(), frame);
+}
+
+SnapshotWriter::SnapshotWriter()
+{
+#ifndef SNAPSHOT_INLINE_WRITES
+    m_worker = std::thread(&SnapshotWriter::workerLoop, this);
+#endif
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    if (m_worker.joinable())
+        m_worker.join();
+}
+
+void SnapshotWriter::submit(const std::string &path, WorldFrame &&frame)
+{
+#ifdef SNAPSHOT_INLINE_WRITES
+    saveSnapshot(path, frame);
+#else
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto pending = std::find_if(m_jobs.begin(), m_jobs.end(), [&](const Job &job) { return job.path == path; });
+        if (pending != m_jobs.end())
+            pending->frame = std::move(frame);
+        else
+            m_jobs.push_back({path, std::move(frame)});
+    }
+    m_wake.notify_one();
+#endif
+}
+
+void SnapshotWriter::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+        if (m_jobs.empty())
+            return; // only reached once stopping with nothing left to write
+
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+
+        lock.unlock();
+        if (!saveSnapshot(job.path, job.frame))
+            fprintf(stderr, "SNAPSHOT: failed to write %s\n", job.path.c_str());
+        lock.lock();
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "PixelWorld.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Binary world snapshots, little-endian:
+//
+//   "PXWS"  magic
+//   u32     version (SNAPSHOT_VERSION)
+//   u32     width, height
+//   u32     run count, value count
+//   runs    { u8 type, varint length }, covering width * height cells in row order
+//   values  { varint index delta, u16 value } for the cells whose value matters
+//
+// Settled worlds are mostly long runs of one material, and only moving or burning cells carry
+// a value, so snapshots stay small. Decoding is a sequence of span fills.
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+// Largest frame a snapshot may hold, 8192 x 8192 cells, far past any world the app runs.
+// Decoding refuses anything bigger before allocating.
+constexpr size_t SNAPSHOT_MAX_CELLS = size_t(1) << 26;
+
+// Cells of this type carry a value in snapshots and in WorldHistory's deltas alike, the two
+// have to agree. Velocity only matters for falling materials and lifetime only for fire.
+inline bool valueMatters(PixelType type)
+{
+    return materialTraits(type).kind != MoveKind::STATIC;
+}
+
+void encodeSnapshot(const WorldFrame &frame, std::vector<uint8_t> &out);
+bool decodeSnapshot(const uint8_t *data, size_t size, WorldFrame &frame);
+
+bool saveSnapshot(const std::string &path, const WorldFrame &frame);
+bool loadSnapshot(const std::string &path, WorldFrame &frame);
+
+// Writes snapshots on a background thread so the frame loop never waits on disk I/O.
+// A newer frame for a path replaces one still waiting for the same path.
+class SnapshotWriter
+{
+public:
+    SnapshotWriter();
+    ~SnapshotWriter(); // writes whatever is still queued
+
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+    void submit(const std::string &path, WorldFrame &&frame);
+
+private:
+    struct Job
+    {
+        std::string path;
+        WorldFrame frame;
+    };
+
+    void workerLoop();
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<Job> m_jobs;
+    bool m_stopping = false;
+    std::thread m_worker;
+};
@@ -0,0 +1,78 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    for (int i = 1; i < threadCount; i++)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &fn)
+{
+    if (m_workers.empty() || count <= 1)
+    {
+        for (int i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &fn;
+        m_jobCount = count;
+        m_nextJob.store(0, std::memory_order_relaxed);
+        m_busyWorkers = static_cast<int>(m_workers.size());
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    // The caller works too instead of just waiting
+    runJobs();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+    m_job = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+    unsigned seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [&] { return m_stopping || m_generation != seenGeneration; });
+        if (m_stopping)
+            return;
+        seenGeneration = m_generation;
+
+        lock.unlock();
+        runJobs();
+        lock.lock();
+
+        if (--m_busyWorkers == 0)
+            m_done.notify_one();
+    }
+}
+
+void ThreadPool::runJobs()
+{
+    int i;
+    while ((i = m_nextJob.fetch_add(1, std::memory_order_relaxed)) < m_jobCount)
+    {
+        (*m_job)(i);
+    }
+}
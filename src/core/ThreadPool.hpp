@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run blocking parallel-for jobs
+class ThreadPool
+{
+public:
+    // threadCount includes the calling thread, so 1 means no workers
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int threadCount() const { return static_cast<int>(m_workers.size()) + 1; }
+
+    // Runs fn(0) .. fn(count - 1) on the workers and the calling thread, returns once all are done
+    void parallelFor(int count, const std::function<void(int)> &fn);
+
+private:
+    void workerLoop();
+    void runJobs();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    const std::function<void(int)> *m_job = nullptr;
+    int m_jobCount = 0;
+    std::atomic<int> m_nextJob{0};
+    int m_busyWorkers = 0;
+    unsigned m_generation = 0;
+    bool m_stopping = false;
+};
@@ -1,7 +1,13 @@
 #include "core/Application.hpp"
+#include <cstring>
 
-int main() {
-    Application app(1280, 720, "My Raylib Game");
+int main(int argc, char **argv) {
+    // --stream pages a world far larger than the screen to disk instead of autosaving the screen
+    bool stream = false;
+    for (int i = 1; i < argc; i++)
+        stream = stream || strcmp(argv[i], "--stream") == 0;
+
+    Application app(1280, 720, "My Raylib Game", stream);
     app.run();
     return 0;
 }
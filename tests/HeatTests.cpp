@@ -0,0 +1,105 @@
+// Heat field tests: the SIMD stencil against the scalar one, fire lighting what it heats, and
+// a burnt-out world going back to ambient. Prints each failure and exits non-zero when any
+// failed.
+#include "HeatField.hpp"
+#include "PixelWorld.hpp"
+#include "Random.hpp"
+#include "Scenario.hpp"
+#include "TestHarness.hpp"
+#include <algorithm>
+#include <cstdio>
+
+static const float DT = 1.0f / 60.0f;
+
+static int countType(const PixelWorld &world, PixelType type)
+{
+    return static_cast<int>(std::count(world.types().begin(), world.types().end(), type));
+}
+
+static void testVectorised()
+{
+    // Widths that leave a scalar tail after the 8-lane blocks
+    const int WIDTH = 37 * HeatField::SAMPLE, HEIGHT = 23 * HeatField::SAMPLE, STEPS = 200;
+    HeatField simd(WIDTH, HEIGHT), scalar(WIDTH, HEIGHT);
+    scalar.setVectorised(false);
+    Random rng(7);
+    for (int sy = 0; sy < simd.height(); sy++)
+    {
+        for (int sx = 0; sx < simd.width(); sx++)
+        {
+            int heat = rng.range(-HeatField::MAX_HEAT, HeatField::MAX_HEAT);
+            simd.add(sx, sy, heat);
+            scalar.add(sx, sy, heat);
+        }
+    }
+
+    bool same = true;
+    for (int step = 0; step < STEPS && same; step++)
+    {
+        simd.step();
+        scalar.step();
+        same = simd.active() == scalar.active();
+        for (int sy = 0; sy < simd.height() && same; sy++)
+        {
+            for (int sx = 0; sx < simd.width() && same; sx++)
+                same = simd.at(sx, sy) == scalar.at(sx, sy);
+        }
+    }
+    expect(same, "vectorised steps match the scalar stencil");
+}
+
+static void testSettles()
+{
+    // Warm samples far below 64 degrees have to cool too, or the field never stops stepping
+    HeatField field(64, 64);
+    for (int sy = 0; sy < field.height(); sy++)
+    {
+        for (int sx = 0; sx < field.width(); sx++)
+            field.add(sx, sy, 63);
+    }
+    int steps = 0;
+    do
+        field.step();
+    while (field.active() && ++steps <= HeatField::SETTLE_STEPS);
+    expect(!field.active(), "a field left alone goes back to ambient within SETTLE_STEPS");
+}
+
+static void testIgnition()
+{
+    PixelWorld world(128, 128, 3);
+    fillRect(world, 0, 96, 128, 128, PixelType::STONE);
+    fillRect(world, 32, 80, 96, 96, PixelType::OIL);
+    fillRect(world, 56, 76, 72, 80, PixelType::FIRE);
+    int oil = countType(world, PixelType::OIL);
+    for (int step = 0; step < 600; step++)
+        world.update(DT);
+    expect(countType(world, PixelType::OIL) < oil, "fire lights the oil it heats");
+}
+
+static void testBurnout()
+{
+    // A burnt-out world with no water has nothing left to cool or heat it
+    const int BURN_STEPS = 20000;
+    PixelWorld world(256, 128, 5);
+    fillRect(world, 0, 112, 256, 128, PixelType::STONE);
+    fillRect(world, 0, 96, 256, 112, PixelType::OIL);
+    fillRect(world, 112, 88, 144, 96, PixelType::FIRE);
+
+    int step = 0;
+    while (countType(world, PixelType::FIRE) > 0 && step++ < BURN_STEPS)
+        world.update(DT);
+    expect(countType(world, PixelType::FIRE) == 0, "the fire burns out");
+
+    for (step = 0; world.heat().active() && step <= HeatField::SETTLE_STEPS; step++)
+        world.update(DT);
+    expect(!world.heat().active(), "heat goes back to ambient once the fire is out");
+}
+
+int main()
+{
+    testVectorised();
+    testSettles();
+    testIgnition();
+    testBurnout();
+    return finish();
+}
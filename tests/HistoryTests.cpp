@@ -0,0 +1,87 @@
+// World history tests: ticks recorded with and without gaps rebuild as the world they were.
+// Prints each failure and exits non-zero when any failed.
+#include "History.hpp"
+#include "TestHarness.hpp"
+#include <cstdio>
+#include <vector>
+
+static const int WIDTH = 64, HEIGHT = 64;
+
+// A frame with one sand cell at x, and the rect covering the row it moves along
+static WorldFrame frameAt(int x)
+{
+    WorldFrame frame;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.types.assign(WIDTH * HEIGHT, PixelType::EMPTY);
+    frame.values.assign(frame.types.size(), 0);
+    frame.types[10 * WIDTH + x] = PixelType::SAND;
+    return frame;
+}
+
+static void record(WorldHistory &history, int x, uint64_t tick)
+{
+    DirtyRect rect;
+    rect.include(0, 10, WIDTH - 1, 10);
+    history.record(frameAt(x).view(), {rect}, tick);
+}
+
+static bool shows(const WorldHistory &history, uint64_t tick, int x)
+{
+    WorldFrame frame;
+    return history.reconstruct(tick, frame) && frame.types == frameAt(x).types;
+}
+
+static void testConsecutive()
+{
+    WorldHistory history;
+    for (int t = 1; t <= 20; t++)
+        record(history, t, t);
+    bool all = history.oldestTick() == 1 && history.newestTick() == 20;
+    for (int t = 1; t <= 20; t++)
+        all = all && shows(history, t, t);
+    expect(all, "consecutive ticks rebuild as recorded");
+}
+
+static void testGap()
+{
+    // Ticks 1-10, then 15-20 after ticks that were never recorded
+    WorldHistory history;
+    for (int t = 1; t <= 10; t++)
+        record(history, t, t);
+    for (int t = 15; t <= 20; t++)
+        record(history, t, t);
+
+    expect(history.oldestTick() == 15 && history.newestTick() == 20, "a gap drops the ticks before it");
+    bool all = true;
+    for (int t = 15; t <= 20; t++)
+        all = all && shows(history, t, t);
+    expect(all, "ticks after a gap rebuild as recorded");
+    expect(!shows(history, 12, 12), "ticks in the gap are not held");
+}
+
+static void testTruncate()
+{
+    // Resuming from an earlier tick records over the ones after it
+    WorldHistory history;
+    for (int t = 1; t <= 20; t++)
+        record(history, t, t);
+    history.truncate(8);
+    for (int t = 9; t <= 12; t++)
+        record(history, 40 + t, t);
+
+    bool all = history.oldestTick() == 1 && history.newestTick() == 12;
+    for (int t = 1; t <= 8; t++)
+        all = all && shows(history, t, t);
+    for (int t = 9; t <= 12; t++)
+        all = all && shows(history, t, 40 + t);
+    expect(all, "ticks recorded after a truncate replace the dropped ones");
+}
+
+int main()
+{
+    testConsecutive();
+    testGap();
+    testTruncate();
+    return finish();
+}
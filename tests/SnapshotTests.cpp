@@ -0,0 +1,94 @@
+// Snapshot encoding tests: round trips, and damaged or hostile files that must be refused
+// without allocating what their headers claim. Prints each failure and exits non-zero when
+// any failed.
+#include "Snapshot.hpp"
+#include "TestHarness.hpp"
+#include <cstdio>
+#include <vector>
+
+static void putU32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+// Magic, version and the four counts, with no payload after them
+static std::vector<uint8_t> header(uint32_t width, uint32_t height, uint32_t runCount, uint32_t valueCount)
+{
+    std::vector<uint8_t> out = {'P', 'X', 'W', 'S'};
+    putU32(out, SNAPSHOT_VERSION);
+    putU32(out, width);
+    putU32(out, height);
+    putU32(out, runCount);
+    putU32(out, valueCount);
+    return out;
+}
+
+static WorldFrame sampleFrame()
+{
+    WorldFrame frame;
+    frame.width = 40;
+    frame.height = 30;
+    frame.types.assign(frame.width * frame.height, PixelType::EMPTY);
+    frame.values.assign(frame.types.size(), 0);
+    for (int i = 0; i < frame.width * frame.height; i += 7)
+    {
+        frame.types[i] = static_cast<PixelType>(i % MATERIAL_COUNT);
+        if (frame.types[i] == PixelType::FIRE || frame.types[i] == PixelType::SAND)
+            frame.values[i] = static_cast<uint16_t>(i * 13);
+    }
+    return frame;
+}
+
+static void testRoundTrip()
+{
+    WorldFrame frame = sampleFrame(), decoded;
+    std::vector<uint8_t> bytes;
+    encodeSnapshot(frame, bytes);
+    expect(decodeSnapshot(bytes.data(), bytes.size(), decoded), "round trip decodes");
+    expect(decoded.width == frame.width && decoded.height == frame.height && decoded.types == frame.types &&
+               decoded.values == frame.values,
+           "round trip gives the frame back");
+}
+
+static void testTruncated()
+{
+    WorldFrame frame = sampleFrame(), decoded;
+    std::vector<uint8_t> bytes;
+    encodeSnapshot(frame, bytes);
+    bool refused = true;
+    for (size_t size = 0; size < bytes.size(); size++)
+        refused = refused && !decodeSnapshot(bytes.data(), size, decoded);
+    expect(refused, "every truncated snapshot is refused");
+}
+
+static void testHostileHeaders()
+{
+    // The largest frame the header allows, with nothing behind it
+    WorldFrame decoded;
+    std::vector<uint8_t> bytes = header(65536, 65536, 1, 0);
+    expect(!decodeSnapshot(bytes.data(), bytes.size(), decoded), "header without a payload is refused");
+    expect(decoded.types.empty() && decoded.values.empty(), "header without a payload allocates nothing");
+
+    // A frame past the cap, with a payload long enough for the counts
+    bytes = header(8192, 8193, 1, 0);
+    bytes.push_back(0);
+    bytes.push_back(1);
+    expect(!decodeSnapshot(bytes.data(), bytes.size(), decoded), "frame past the cap is refused");
+    expect(decoded.types.empty(), "frame past the cap allocates nothing");
+
+    // Runs that stop short of the frame
+    bytes = header(64, 64, 1, 0);
+    bytes.push_back(0);
+    bytes.push_back(10);
+    expect(!decodeSnapshot(bytes.data(), bytes.size(), decoded), "runs short of the frame are refused");
+    expect(decoded.types.empty(), "runs short of the frame allocate nothing");
+}
+
+int main()
+{
+    testRoundTrip();
+    testTruncated();
+    testHostileHeaders();
+    return finish();
+}
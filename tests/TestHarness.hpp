@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdio>
+
+// Failure counting shared by the test programs: each failed expectation is printed, and
+// finish() gives main its exit code
+
+inline int failures = 0;
+
+inline void expect(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FAIL %s\n", what);
+        failures++;
+    }
+}
+
+// Prints ok or FAIL, returns non-zero when anything failed
+inline int finish()
+{
+    printf("%s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
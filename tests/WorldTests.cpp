@@ -0,0 +1,42 @@
+// Behaviour tests for PixelWorld that the differential checker can't see, every engine
+// against the same expectation. Prints each failure and exits non-zero when any failed.
+#include "PixelWorld.hpp"
+#include <cstdio>
+
+// A grain on the end of a two-cell ledge has one open diagonal. Cells pick a side at random,
+// so the grain must keep trying until it takes the open one rather than fall asleep.
+static int testLedge()
+{
+    const int SEEDS = 200, STEPS = 200;
+    int failures = 0;
+    for (UpdateMode mode : UPDATE_MODES)
+    {
+        int stuck = 0;
+        for (int seed = 1; seed <= SEEDS; seed++)
+        {
+            PixelWorld world(64, 64, seed);
+            world.setUpdateMode(mode);
+            world.addPixel(30, 32, PixelType::STONE);
+            world.addPixel(31, 32, PixelType::STONE);
+            world.addPixel(30, 31, PixelType::SAND);
+            for (int step = 0; step < STEPS; step++)
+                world.update(1.0f / 60.0f);
+            if (world.types()[31 * world.width() + 30] == PixelType::SAND)
+                stuck++;
+        }
+        if (stuck > 0)
+        {
+            fprintf(stderr, "ledge, %s: grain still on the ledge after %d steps in %d of %d seeds\n",
+                    updateModeName(mode), STEPS, stuck, SEEDS);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = testLedge();
+    printf("%s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,260 @@
+// Headless batch runner. Sets a scenario up once per seed, runs every world for the same
+// number of steps and keeps the final state, one world per pool thread at a time.
+//
+//   SandboxBatch --scenario NAME|start.pxw --seeds 1-64,100 [--steps N] [--size WxH]
+//                [--mode serial|checkerboard|bitplane|margolus] [--jobs N] [--out DIR] [--images]
+//
+// Each run writes DIR/<seed>.pxw, and DIR/<seed>.ppm with --images. DIR/stats.json lists
+// every run's timing and final material counts. A .pxw scenario starts every seed from that
+// snapshot at its own size, --size only applies to the built-in scenarios.
+//
+// Throughput, -O2 -march=native on a single core, so the jobs past one only show what the
+// pool costs there:
+//
+//   SandboxBatch --scenario demolition --seeds 1-32 --steps 1200 --jobs N
+//   N = 1: 10.1 s, 11400 worlds/hour   N = 2: 11.3 s, 10200   N = 4: 11.5 s, 10000
+//
+// Worlds share nothing but the run counter, so it should scale with cores until memory
+// bandwidth runs out, but that is unmeasured.
+#include "PixelWorld.hpp"
+#include "Scenario.hpp"
+#include "Snapshot.hpp"
+#include "ThreadPool.hpp"
+#include "ToolArgs.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BatchConfig
+{
+    std::string scenario;
+    std::vector<uint64_t> seeds;
+    int steps = 600;
+    int width = 640, height = 360;
+    UpdateMode mode = UpdateMode::SERIAL;
+    int jobs = 0; // every hardware thread
+    std::string out = "batch";
+    bool images = false;
+};
+
+struct RunResult
+{
+    uint64_t seed;
+    double ms;
+    int settledStep; // -1 if never
+    int activeChunks; // after the last step
+    std::array<long, MATERIAL_COUNT> counts;
+    bool saved;
+};
+
+static bool parseArgs(int argc, char **argv, BatchConfig &config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--images") == 0)
+        {
+            config.images = true;
+            continue;
+        }
+
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+        {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        i++;
+
+        if (strcmp(arg, "--scenario") == 0)
+            config.scenario = value;
+        else if (strcmp(arg, "--steps") == 0)
+            config.steps = std::max(atoi(value), 0);
+        else if (strcmp(arg, "--jobs") == 0)
+            config.jobs = std::max(atoi(value), 1);
+        else if (strcmp(arg, "--out") == 0)
+            config.out = value;
+        else if (strcmp(arg, "--seeds") == 0)
+        {
+            if (!parseSeeds(value, config.seeds))
+            {
+                fprintf(stderr, "bad seeds %s, expected a list like 1-64,100 of at most %llu seeds\n", value,
+                        static_cast<unsigned long long>(MAX_SEEDS));
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--size") == 0)
+        {
+            if (sscanf(value, "%dx%d", &config.width, &config.height) != 2 || config.width <= 0 || config.height <= 0)
+            {
+                fprintf(stderr, "bad size %s, expected WxH\n", value);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--mode") == 0)
+        {
+            if (!parseUpdateMode(value, config.mode))
+            {
+                fprintf(stderr, "bad mode %s, expected serial, checkerboard, bitplane or margolus\n", value);
+                return false;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (config.scenario.empty() || config.seeds.empty())
+    {
+        fprintf(stderr, "--scenario and --seeds are required\n");
+        return false;
+    }
+    return true;
+}
+
+// Binary PPM in the material colours, empty cells black
+static bool saveImage(const std::string &path, const PixelView &view)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    fprintf(f, "P6\n%d %d\n255\n", view.width, view.height);
+    std::vector<uint8_t> row(3 * view.width);
+    for (int y = 0; y < view.height; y++)
+    {
+        for (int x = 0; x < view.width; x++)
+        {
+            const uint8_t *color = materialTraits(view.types[y * view.width + x]).color;
+            std::copy_n(color, 3, &row[3 * x]);
+        }
+        fwrite(row.data(), 1, row.size(), f);
+    }
+    return fclose(f) == 0;
+}
+
+static void writeStats(FILE *f, const BatchConfig &config, const std::vector<RunResult> &results, double wallSeconds, int jobs)
+{
+    fprintf(f, "{\n  \"scenario\": \"%s\",\n  \"steps\": %d,\n  \"mode\": \"%s\",\n", config.scenario.c_str(),
+            config.steps, updateModeName(config.mode));
+    fprintf(f, "  \"jobs\": %d,\n  \"wall_seconds\": %.3f,\n  \"worlds_per_hour\": %.1f,\n  \"runs\": [\n", jobs,
+            wallSeconds, results.size() * 3600.0 / wallSeconds);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const RunResult &r = results[i];
+        std::string settled = r.settledStep < 0 ? "null" : std::to_string(r.settledStep);
+        fprintf(f, "    {\"seed\": %llu, \"ms\": %.2f, \"settled_step\": %s, \"active_chunks\": %d, \"saved\": %s, \"cells\": {",
+                static_cast<unsigned long long>(r.seed), r.ms, settled.c_str(), r.activeChunks, r.saved ? "true" : "false");
+        for (int m = 1; m < MATERIAL_COUNT; m++)
+            fprintf(f, "\"%s\": %ld%s", MATERIALS[m].name, r.counts[m], m + 1 < MATERIAL_COUNT ? ", " : "");
+        fprintf(f, "}}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    BatchConfig config;
+    if (!parseArgs(argc, argv, config))
+        return 1;
+
+    // A snapshot scenario is decoded once and copied into every world
+    const Scenario *scenario = findScenario(config.scenario);
+    WorldFrame start;
+    if (!scenario)
+    {
+        if (!loadSnapshot(config.scenario, start))
+        {
+            fprintf(stderr, "%s is neither a scenario nor a snapshot\n", config.scenario.c_str());
+            return 1;
+        }
+        config.width = start.width;
+        config.height = start.height;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(config.out, error);
+    if (error)
+    {
+        fprintf(stderr, "cannot create %s\n", config.out.c_str());
+        return 1;
+    }
+
+    // Whole runs are the jobs, each world steps on whichever thread took it. Threads take the
+    // next run as they finish one, so uneven runs still keep every core busy.
+    int jobs = config.jobs > 0 ? config.jobs : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    jobs = std::min(jobs, static_cast<int>(config.seeds.size()));
+    ThreadPool pool(jobs);
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<RunResult> results(config.seeds.size());
+    std::mutex printMutex;
+    int finished = 0;
+    auto batchStart = Clock::now();
+    pool.parallelFor(static_cast<int>(config.seeds.size()), [&](int run)
+                     {
+                         RunResult &r = results[run];
+                         r.seed = config.seeds[run];
+                         auto runStart = Clock::now();
+
+                         PixelWorld world(config.width, config.height, r.seed);
+                         world.setUpdateMode(config.mode);
+                         if (scenario)
+                             scenario->setup(world);
+                         else
+                             world.loadFrame(start);
+
+                         r.settledStep = -1;
+                         for (int step = 0; step < config.steps; step++)
+                         {
+                             if (scenario && scenario->tick)
+                                 scenario->tick(world, step);
+                             world.update(1.0f / 60.0f);
+                             if (world.activeChunkCount() > 0 || world.particleCount() > 0)
+                                 r.settledStep = -1;
+                             else if (r.settledStep < 0)
+                                 r.settledStep = step;
+                         }
+                         r.activeChunks = world.activeChunkCount();
+                         r.counts.fill(0);
+                         for (PixelType type : world.types())
+                             r.counts[static_cast<int>(type)]++;
+
+                         WorldFrame frame;
+                         world.copyFrame(frame);
+                         std::string path = config.out + "/" + std::to_string(r.seed);
+                         r.saved = saveSnapshot(path + ".pxw", frame) &&
+                                   (!config.images || saveImage(path + ".ppm", frame.view()));
+                         r.ms = std::chrono::duration<double, std::milli>(Clock::now() - runStart).count();
+
+                         std::lock_guard<std::mutex> lock(printMutex);
+                         finished++;
+                         fprintf(stderr, "[%d/%zu] seed %llu: %.1f ms%s\n", finished, config.seeds.size(),
+                                 static_cast<unsigned long long>(r.seed), r.ms, r.saved ? "" : ", not saved");
+                     });
+    double wallSeconds = std::chrono::duration<double>(Clock::now() - batchStart).count();
+    fprintf(stderr, "%zu worlds in %.2f s on %d threads, %.0f worlds/hour\n", results.size(), wallSeconds, jobs,
+            results.size() * 3600.0 / wallSeconds);
+
+    std::string statsPath = config.out + "/stats.json";
+    FILE *f = fopen(statsPath.c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "cannot write %s\n", statsPath.c_str());
+        return 1;
+    }
+    writeStats(f, config, results, wallSeconds, jobs);
+    fclose(f);
+
+    bool allSaved = std::all_of(results.begin(), results.end(), [](const RunResult &r) { return r.saved; });
+    return allSaved ? 0 : 1;
+}
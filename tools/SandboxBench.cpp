@@ -0,0 +1,346 @@
+// Headless PixelWorld benchmark. Runs the built-in scenarios at several world sizes and
+// update configurations and prints the timings as JSON.
+//
+//   SandboxBench [--steps N] [--warmup N] [--sizes 320x180,640x360] [--scenarios a,b]
+//                [--modes serial,checkerboard,bitplane,margolus] [--threads 1,2,4] [--row-masks on,off] [--levelling on,off] [--seed N]
+//                [--budget MS] [--out results.json] [--trace trace.json]
+//
+// settled_step is the first step, warmup included, after which every chunk was asleep and
+// nothing was in flight; null when the scenario never went quiet within the run.
+// --budget runs every configuration on a per-update budget focused on the middle of the
+// world, deferred_chunks is the mean number of awake chunks held back per step.
+// --trace writes every step as a Chrome trace, and the same events to trace.json.csv.
+// Profiling builds (-DSANDBOX_PROFILE=ON) only.
+#include "PixelWorld.hpp"
+#include "Profiler.hpp"
+#include "Scenario.hpp"
+#include "ToolArgs.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchConfig
+{
+    int steps = 600;
+    int warmup = 60;
+    uint64_t seed = 1;
+    std::vector<std::pair<int, int>> sizes = {{320, 180}, {640, 360}, {1280, 720}, {1920, 1080}};
+    std::vector<std::string> scenarios;
+    std::vector<UpdateMode> modes{std::begin(UPDATE_MODES), std::end(UPDATE_MODES)};
+    std::vector<int> threads;
+    std::vector<bool> rowMasks = {true};
+    std::vector<bool> levelling = {false};
+    float budgetMs = 0.0f;
+    const char *out = nullptr;
+    const char *trace = nullptr;
+};
+
+struct BenchResult
+{
+    std::string scenario;
+    int width, height;
+    const char *mode;
+    int threads;
+    bool rowMasks;
+    bool levelling;
+    double nsPerCellStep;
+    double stepsPerSecond;
+    double p50, p90, p99, max; // step times in ms
+    double activeChunks;       // mean awake chunks per step
+    double deferredChunks;     // mean held back by the budget per step
+    int settledStep;           // -1 if never
+};
+
+static bool parseArgs(int argc, char **argv, BenchConfig &config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+        {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        i++;
+
+        if (strcmp(arg, "--steps") == 0)
+            config.steps = atoi(value);
+        else if (strcmp(arg, "--warmup") == 0)
+            config.warmup = atoi(value);
+        else if (strcmp(arg, "--seed") == 0)
+            config.seed = strtoull(value, nullptr, 10);
+        else if (strcmp(arg, "--out") == 0)
+            config.out = value;
+        else if (strcmp(arg, "--budget") == 0)
+            config.budgetMs = std::max(static_cast<float>(atof(value)), 0.0f);
+        else if (strcmp(arg, "--trace") == 0)
+            config.trace = value;
+        else if (strcmp(arg, "--scenarios") == 0)
+            config.scenarios = splitList(value);
+        else if (strcmp(arg, "--modes") == 0)
+        {
+            config.modes.clear();
+            for (const std::string &item : splitList(value))
+            {
+                UpdateMode mode;
+                if (!parseUpdateMode(item, mode))
+                {
+                    fprintf(stderr, "bad mode %s, expected serial, checkerboard, bitplane or margolus\n", item.c_str());
+                    return false;
+                }
+                config.modes.push_back(mode);
+            }
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            config.threads.clear();
+            for (const std::string &item : splitList(value))
+                config.threads.push_back(std::max(atoi(item.c_str()), 1));
+        }
+        else if (strcmp(arg, "--row-masks") == 0 || strcmp(arg, "--levelling") == 0)
+        {
+            std::vector<bool> &settings = strcmp(arg, "--row-masks") == 0 ? config.rowMasks : config.levelling;
+            settings.clear();
+            for (const std::string &item : splitList(value))
+            {
+                if (item != "on" && item != "off")
+                {
+                    fprintf(stderr, "bad %s setting %s, expected on or off\n", arg + 2, item.c_str());
+                    return false;
+                }
+                settings.push_back(item == "on");
+            }
+        }
+        else if (strcmp(arg, "--sizes") == 0)
+        {
+            config.sizes.clear();
+            for (const std::string &item : splitList(value))
+            {
+                int w = 0, h = 0;
+                if (sscanf(item.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+                {
+                    fprintf(stderr, "bad size %s, expected WxH\n", item.c_str());
+                    return false;
+                }
+                config.sizes.push_back({w, h});
+            }
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static BenchResult runOne(const BenchConfig &config, const Scenario &scenario, int width, int height,
+                          UpdateMode mode, int threads, bool rowMasks, bool levelling)
+{
+    using Clock = std::chrono::steady_clock;
+    const float dt = 1.0f / 60.0f;
+
+    PixelWorld world(width, height, config.seed);
+    world.setUpdateMode(mode);
+    world.setThreadCount(threads);
+    world.setRowMasks(rowMasks);
+    world.setLiquidLevelling(levelling);
+    world.setUpdateBudget(config.budgetMs);
+    world.setFocus(width / 2, height / 2);
+    scenario.setup(world);
+
+    int settledStep = -1;
+    auto noteSettled = [&](int step)
+    {
+        if (world.activeChunkCount() > 0 || world.particleCount() > 0)
+            settledStep = -1;
+        else if (settledStep < 0)
+            settledStep = step;
+    };
+
+    for (int step = 0; step < config.warmup; step++)
+    {
+        if (scenario.tick)
+            scenario.tick(world, step);
+        world.update(dt);
+        noteSettled(step);
+    }
+
+    std::vector<double> stepMs(config.steps);
+    double totalMs = 0.0;
+    double activeChunks = 0.0, deferredChunks = 0.0;
+    for (int step = 0; step < config.steps; step++)
+    {
+        if (scenario.tick)
+            scenario.tick(world, config.warmup + step);
+        PROFILE_SAMPLE_COUNTERS();
+
+        auto start = Clock::now();
+        world.update(dt);
+        stepMs[step] = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        totalMs += stepMs[step];
+        activeChunks += world.activeChunkCount();
+        deferredChunks += world.deferredChunkCount();
+        noteSettled(config.warmup + step);
+    }
+    std::sort(stepMs.begin(), stepMs.end());
+
+    BenchResult result;
+    result.scenario = scenario.name;
+    result.width = width;
+    result.height = height;
+    result.mode = updateModeName(mode);
+    result.threads = threads;
+    result.rowMasks = rowMasks;
+    result.levelling = levelling;
+    result.nsPerCellStep = totalMs * 1e6 / (static_cast<double>(width) * height * config.steps);
+    result.stepsPerSecond = config.steps * 1000.0 / totalMs;
+    result.p50 = percentile(stepMs, 0.50);
+    result.p90 = percentile(stepMs, 0.90);
+    result.p99 = percentile(stepMs, 0.99);
+    result.max = stepMs.back();
+    result.activeChunks = activeChunks / config.steps;
+    result.deferredChunks = deferredChunks / config.steps;
+    result.settledStep = settledStep;
+    return result;
+}
+
+static void writeJson(FILE *f, const BenchConfig &config, const std::vector<BenchResult> &results)
+{
+    fprintf(f, "{\n  \"benchmark\": \"SandboxBench\",\n");
+    fprintf(f, "  \"steps\": %d,\n  \"warmup\": %d,\n  \"seed\": %llu,\n  \"budget_ms\": %.2f,\n", config.steps,
+            config.warmup, static_cast<unsigned long long>(config.seed), config.budgetMs);
+    fprintf(f, "  \"hardware_threads\": %u,\n  \"results\": [\n", std::thread::hardware_concurrency());
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        std::string settled = r.settledStep < 0 ? "null" : std::to_string(r.settledStep);
+        fprintf(f,
+                "    {\"scenario\": \"%s\", \"width\": %d, \"height\": %d, \"mode\": \"%s\", \"threads\": %d, \"row_masks\": %s, "
+                "\"levelling\": %s, \"ns_per_cell_step\": %.4f, \"steps_per_sec\": %.2f, "
+                "\"step_ms\": {\"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}, "
+                "\"active_chunks\": %.1f, \"deferred_chunks\": %.1f, \"settled_step\": %s}%s\n",
+                r.scenario.c_str(), r.width, r.height, r.mode, r.threads, r.rowMasks ? "true" : "false",
+                r.levelling ? "true" : "false", r.nsPerCellStep, r.stepsPerSecond, r.p50, r.p90, r.p99, r.max,
+                r.activeChunks, r.deferredChunks, settled.c_str(), i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config;
+    if (!parseArgs(argc, argv, config))
+        return 1;
+
+#ifdef SANDBOX_PROFILE
+    PROFILE_THREAD("bench");
+    if (config.trace)
+        Profiler::get().startCapture();
+#else
+    if (config.trace)
+    {
+        fprintf(stderr, "--trace needs a profiling build\n");
+        return 1;
+    }
+#endif
+
+    std::vector<const Scenario *> scenarios;
+    if (config.scenarios.empty())
+    {
+        for (const Scenario &scenario : builtinScenarios())
+            scenarios.push_back(&scenario);
+    }
+    for (const std::string &name : config.scenarios)
+    {
+        const Scenario *scenario = findScenario(name);
+        if (!scenario)
+        {
+            fprintf(stderr, "unknown scenario %s\n", name.c_str());
+            return 1;
+        }
+        scenarios.push_back(scenario);
+    }
+
+    // Default thread sweep: 1, 2, 4 .. up to every hardware thread
+    if (config.threads.empty())
+    {
+        int hardware = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+        for (int n = 1; n < hardware; n *= 2)
+            config.threads.push_back(n);
+        config.threads.push_back(hardware);
+    }
+
+    std::vector<BenchResult> results;
+    auto run = [&](const Scenario &scenario, int width, int height, UpdateMode mode, int threads)
+    {
+        for (bool rowMasks : config.rowMasks)
+        {
+            for (bool levelling : config.levelling)
+            {
+                results.push_back(runOne(config, scenario, width, height, mode, threads, rowMasks, levelling));
+                const BenchResult &r = results.back();
+                fprintf(stderr, "%-15s %5dx%-5d %-12s %2dt %-4s %-5s %9.3f ns/cell/step %9.1f steps/s  p99 %.2f ms  settled %d\n",
+                        r.scenario.c_str(), r.width, r.height, r.mode, r.threads, r.rowMasks ? "mask" : "scan",
+                        r.levelling ? "level" : "flow", r.nsPerCellStep, r.stepsPerSecond, r.p99, r.settledStep);
+            }
+        }
+    };
+
+    for (const Scenario *scenario : scenarios)
+    {
+        for (auto [width, height] : config.sizes)
+        {
+            // Checkerboard and margolus are swept over thread counts, the other modes run on one thread
+            for (UpdateMode mode : config.modes)
+            {
+                if (mode == UpdateMode::CHECKERBOARD || mode == UpdateMode::MARGOLUS)
+                {
+                    for (int threads : config.threads)
+                        run(*scenario, width, height, mode, threads);
+                }
+                else
+                {
+                    run(*scenario, width, height, mode, 1);
+                }
+            }
+        }
+    }
+
+    FILE *f = config.out ? fopen(config.out, "w") : stdout;
+    if (!f)
+    {
+        fprintf(stderr, "cannot write %s\n", config.out);
+        return 1;
+    }
+    writeJson(f, config, results);
+    if (f != stdout)
+        fclose(f);
+
+#ifdef SANDBOX_PROFILE
+    if (config.trace)
+    {
+        std::string csv = std::string(config.trace) + ".csv";
+        Profiler::get().stopCapture();
+        if (!Profiler::get().writeChromeTrace(config.trace) || !Profiler::get().writeCsv(csv))
+        {
+            fprintf(stderr, "cannot write %s\n", config.trace);
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,492 @@
+// Differential checker for the update engines. Runs the reference engine, the serial update
+// every other one has to behave like, and the candidate engines over the same seeded
+// scenarios. Checks invariants after every step of every run, then compares what the worlds
+// look like at the end against the reference's.
+//
+//   SandboxCheck [--engines checkerboard,bitplane,margolus,scalar,budgeted] [--scenarios a,b]
+//                [--seeds 1-4] [--steps N] [--size WxH] [--jobs N]
+//
+// Invariants, every step of every engine, the reference included:
+//   mass     cells plus particles of each material stay the same across an update, save that
+//            flammable ones may burn away and fire comes and goes
+//   stone    no stone cell moves, unless a blast has stone in flight
+//   resting  no sand sits on a liquid for more than RESTING_STEPS steps in a row
+// Signatures of the settled worlds, averaged over the seeds, each engine's against the
+// reference's:
+//   surface  height of the top surface in bins of SURFACE_BIN columns
+//   amounts  share of the cells each material holds, what burnt away
+//   layers   mean height of each material
+//   slope    mean angle of the sand-topped surface, how steep the piles stand
+//
+// Scenario ticks drive the first half of each run, the second half lets the world settle.
+// Engines draw different random numbers, so signatures only have to agree within tolerances.
+// Scenarios still moving for the reference at the end are only checked for invariants.
+// Prints one line per scenario and engine, exits non-zero when anything failed.
+#include "PixelWorld.hpp"
+#include "Scenario.hpp"
+#include "ThreadPool.hpp"
+#include "ToolArgs.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Steps sand may sit still on a liquid before it counts as resting there
+static const int RESTING_STEPS = 30;
+static const int SURFACE_BIN = 16;
+// Columns apart the slope is measured over
+static const int SLOPE_RUN = 4;
+// Largest signature differences from the reference that still pass, heights as a share of
+// the world's height
+static const double SURFACE_TOLERANCE = 0.04;
+static const double LAYER_TOLERANCE = 0.04;
+static const double AMOUNT_TOLERANCE = 0.01; // as a share of all cells
+static const double SLOPE_TOLERANCE = 6.0;   // degrees
+// Failures kept per run, the first one is usually the one that matters
+static const int MAX_REPORTED = 3;
+
+static const double PI = 3.14159265358979323846;
+
+struct Engine
+{
+    const char *name;
+    const char *description;
+    void (*configure)(PixelWorld &world);
+};
+
+// The first is the reference
+static const Engine ENGINES[] = {
+    {"serial", "rows bottom-up on one thread", [](PixelWorld &) {}},
+    {"checkerboard", "chunks in 4 phases on 4 threads",
+     [](PixelWorld &world)
+     {
+         world.setUpdateMode(UpdateMode::CHECKERBOARD);
+         world.setThreadCount(4);
+     }},
+    {"bitplane", "per-material bitplane rows", [](PixelWorld &world) { world.setUpdateMode(UpdateMode::BITPLANE); }},
+    {"margolus", "2x2 block rules on 4 threads",
+     [](PixelWorld &world)
+     {
+         world.setUpdateMode(UpdateMode::MARGOLUS);
+         world.setThreadCount(4);
+     }},
+    {"scalar", "serial, scanning every cell instead of row masks", [](PixelWorld &world) { world.setRowMasks(false); }},
+    {"budgeted", "serial on a tight update budget around the middle",
+     [](PixelWorld &world)
+     {
+         world.setUpdateBudget(0.05f);
+         world.setFocus(world.width() / 2, world.height() / 2);
+     }},
+};
+
+struct CheckConfig
+{
+    std::vector<const Engine *> engines; // candidates, the reference always runs
+    std::vector<const Scenario *> scenarios;
+    std::vector<uint64_t> seeds = {1, 2, 3, 4};
+    int steps = 2000;
+    int width = 320, height = 180;
+    int jobs = 0; // every hardware thread
+};
+
+struct Signature
+{
+    std::vector<double> surface;                  // mean height per bin
+    std::array<double, MATERIAL_COUNT> amounts{}; // share of the cells
+    std::array<double, MATERIAL_COUNT> layers{};  // mean height, -1 where the material is gone
+    double slope = -1.0;                          // degrees, -1 without sand on top
+};
+
+struct RunResult
+{
+    std::vector<std::string> failures;
+    int failureCount = 0;
+    bool settled = false; // nothing awake and nothing in flight after the last step
+    Signature signature;
+};
+
+static bool parseArgs(int argc, char **argv, CheckConfig &config)
+{
+    std::vector<std::string> engines, scenarios;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value)
+        {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        i++;
+
+        if (strcmp(arg, "--engines") == 0)
+            engines = splitList(value);
+        else if (strcmp(arg, "--scenarios") == 0)
+            scenarios = splitList(value);
+        else if (strcmp(arg, "--steps") == 0)
+            config.steps = std::max(atoi(value), 1);
+        else if (strcmp(arg, "--jobs") == 0)
+            config.jobs = std::max(atoi(value), 1);
+        else if (strcmp(arg, "--seeds") == 0)
+        {
+            if (!parseSeeds(value, config.seeds))
+            {
+                fprintf(stderr, "bad seeds %s, expected a list like 1-4,10 of at most %llu seeds\n", value,
+                        static_cast<unsigned long long>(MAX_SEEDS));
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--size") == 0)
+        {
+            if (sscanf(value, "%dx%d", &config.width, &config.height) != 2 || config.width <= 0 || config.height <= 0)
+            {
+                fprintf(stderr, "bad size %s, expected WxH\n", value);
+                return false;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    for (const Engine &engine : ENGINES)
+    {
+        bool wanted = engines.empty() ? &engine != ENGINES
+                                      : std::find(engines.begin(), engines.end(), engine.name) != engines.end();
+        if (wanted)
+            config.engines.push_back(&engine);
+    }
+    for (const std::string &name : engines)
+    {
+        if (std::none_of(std::begin(ENGINES), std::end(ENGINES), [&](const Engine &e) { return name == e.name; }))
+        {
+            fprintf(stderr, "unknown engine %s\n", name.c_str());
+            return false;
+        }
+    }
+
+    if (scenarios.empty())
+    {
+        for (const Scenario &scenario : builtinScenarios())
+            config.scenarios.push_back(&scenario);
+    }
+    for (const std::string &name : scenarios)
+    {
+        const Scenario *scenario = findScenario(name);
+        if (!scenario)
+        {
+            fprintf(stderr, "unknown scenario %s\n", name.c_str());
+            return false;
+        }
+        config.scenarios.push_back(scenario);
+    }
+    return true;
+}
+
+// Cells plus particles of each material
+static std::array<long, MATERIAL_COUNT> countMaterials(const PixelWorld &world)
+{
+    std::array<long, MATERIAL_COUNT> counts{};
+    for (PixelType type : world.types())
+        counts[static_cast<int>(type)]++;
+    const ParticleLayer &particles = world.particles();
+    for (int i = 0; i < particles.size(); i++)
+        counts[static_cast<int>(particles.type(i))]++;
+    return counts;
+}
+
+static bool stoneInFlight(const PixelWorld &world)
+{
+    const ParticleLayer &particles = world.particles();
+    for (int i = 0; i < particles.size(); i++)
+    {
+        if (particles.type(i) == PixelType::STONE)
+            return true;
+    }
+    return false;
+}
+
+static Signature measure(const PixelWorld &world)
+{
+    const int w = world.width(), h = world.height();
+    const PixelType *types = world.data().types;
+
+    // Top surface: the first cell down each column that isn't air or flame
+    std::vector<int> top(w, h);
+    for (int x = 0; x < w; x++)
+    {
+        for (int y = 0; y < h; y++)
+        {
+            PixelType type = types[y * w + x];
+            if (type != PixelType::EMPTY && type != PixelType::FIRE)
+            {
+                top[x] = y;
+                break;
+            }
+        }
+    }
+
+    Signature s;
+    for (int x0 = 0; x0 < w; x0 += SURFACE_BIN)
+    {
+        int x1 = std::min(x0 + SURFACE_BIN, w);
+        double sum = 0.0;
+        for (int x = x0; x < x1; x++)
+            sum += h - top[x];
+        s.surface.push_back(sum / (x1 - x0));
+    }
+
+    std::array<double, MATERIAL_COUNT> heights{};
+    std::array<long, MATERIAL_COUNT> counts{};
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            int m = static_cast<int>(types[y * w + x]);
+            heights[m] += h - 1 - y;
+            counts[m]++;
+        }
+    }
+    for (int m = 0; m < MATERIAL_COUNT; m++)
+    {
+        s.amounts[m] = static_cast<double>(counts[m]) / (w * h);
+        s.layers[m] = counts[m] > 0 ? heights[m] / counts[m] : -1.0;
+    }
+
+    double rise = 0.0;
+    int runs = 0;
+    for (int x = 0; x + SLOPE_RUN < w; x++)
+    {
+        auto sandTopped = [&](int c) { return top[c] < h && types[top[c] * w + c] == PixelType::SAND; };
+        if (sandTopped(x) && sandTopped(x + SLOPE_RUN))
+        {
+            rise += std::abs(top[x + SLOPE_RUN] - top[x]);
+            runs++;
+        }
+    }
+    if (runs > 0)
+        s.slope = std::atan(rise / runs / SLOPE_RUN) * 180.0 / PI;
+    return s;
+}
+
+static RunResult runOne(const CheckConfig &config, const Scenario &scenario, const Engine &engine, uint64_t seed)
+{
+    RunResult r;
+    auto fail = [&](int step, const char *invariant, const std::string &detail)
+    {
+        if (r.failureCount++ < MAX_REPORTED)
+            r.failures.push_back("step " + std::to_string(step) + ", " + invariant + ": " + detail);
+    };
+
+    PixelWorld world(config.width, config.height, seed);
+    engine.configure(world);
+    scenario.setup(world);
+
+    const int cells = config.width * config.height;
+    std::vector<PixelType> before(cells);
+    std::vector<uint16_t> resting(cells, 0);
+    for (int step = 0; step < config.steps; step++)
+    {
+        // Scenario ticks add and blast cells on purpose, the update itself has to keep them
+        if (scenario.tick && step < config.steps / 2)
+            scenario.tick(world, step);
+        std::array<long, MATERIAL_COUNT> counts = countMaterials(world);
+        std::copy(world.types().begin(), world.types().end(), before.begin());
+        bool stoneFlying = stoneInFlight(world);
+
+        world.update(1.0f / 60.0f);
+
+        std::array<long, MATERIAL_COUNT> after = countMaterials(world);
+        for (int m = 1; m < MATERIAL_COUNT; m++)
+        {
+            const MaterialTraits &traits = MATERIALS[m];
+            bool lost = after[m] < counts[m], gained = after[m] > counts[m];
+            if (traits.kind != MoveKind::FIRE && (gained || (lost && !traits.flammable)))
+                fail(step, "mass", std::string(traits.name) + " went from " + std::to_string(counts[m]) + " to " +
+                                       std::to_string(after[m]));
+        }
+
+        const PixelType *types = world.data().types;
+        const uint16_t *values = world.data().values;
+        if (!stoneFlying && !stoneInFlight(world))
+        {
+            for (int i = 0; i < cells; i++)
+            {
+                if ((before[i] == PixelType::STONE) != (types[i] == PixelType::STONE))
+                {
+                    fail(step, "stone", "cell " + std::to_string(i % config.width) + "," + std::to_string(i / config.width) +
+                                            (types[i] == PixelType::STONE ? " became stone" : " lost its stone"));
+                    break;
+                }
+            }
+        }
+
+        for (int i = 0; i + config.width < cells; i++)
+        {
+            // Sand sinking through a liquid keeps some velocity, sand that found nowhere to go has none
+            bool onLiquid = types[i] == PixelType::SAND && values[i] == 0 &&
+                            materialTraits(types[i + config.width]).kind == MoveKind::LIQUID;
+            resting[i] = onLiquid ? resting[i] + 1 : 0;
+            if (resting[i] == RESTING_STEPS)
+                fail(step, "resting", "sand at " + std::to_string(i % config.width) + "," +
+                                          std::to_string(i / config.width) + " has sat on " +
+                                          materialTraits(types[i + config.width]).name + " for " +
+                                          std::to_string(RESTING_STEPS) + " steps");
+        }
+    }
+
+    r.settled = world.activeChunkCount() == 0 && world.particleCount() == 0;
+    r.signature = measure(world);
+    return r;
+}
+
+static Signature average(const std::vector<RunResult> &runs)
+{
+    Signature mean;
+    mean.surface.assign(runs[0].signature.surface.size(), 0.0);
+    std::array<int, MATERIAL_COUNT> present{};
+    int sloped = 0;
+    mean.slope = 0.0;
+    for (const RunResult &run : runs)
+    {
+        const Signature &s = run.signature;
+        for (size_t b = 0; b < s.surface.size(); b++)
+            mean.surface[b] += s.surface[b] / runs.size();
+        for (int m = 0; m < MATERIAL_COUNT; m++)
+        {
+            mean.amounts[m] += s.amounts[m] / runs.size();
+            if (s.layers[m] >= 0.0)
+            {
+                mean.layers[m] += s.layers[m];
+                present[m]++;
+            }
+        }
+        if (s.slope >= 0.0)
+        {
+            mean.slope += s.slope;
+            sloped++;
+        }
+    }
+    mean.slope = sloped > 0 ? mean.slope / sloped : -1.0;
+    for (int m = 0; m < MATERIAL_COUNT; m++)
+        mean.layers[m] = present[m] > 0 ? mean.layers[m] / present[m] : -1.0;
+    return mean;
+}
+
+// Describes how far a signature strays from the reference's, empty when within tolerance
+static std::vector<std::string> compare(const Signature &reference, const Signature &candidate, int height)
+{
+    std::vector<std::string> problems;
+    char line[160];
+
+    double surface = 0.0;
+    for (size_t b = 0; b < reference.surface.size(); b++)
+        surface += std::abs(candidate.surface[b] - reference.surface[b]) / reference.surface.size();
+    if (surface > SURFACE_TOLERANCE * height)
+    {
+        snprintf(line, sizeof(line), "surface off by %.1f cells on average, %.1f allowed", surface, SURFACE_TOLERANCE * height);
+        problems.push_back(line);
+    }
+
+    for (int m = 1; m < MATERIAL_COUNT; m++)
+    {
+        if (std::abs(candidate.amounts[m] - reference.amounts[m]) > AMOUNT_TOLERANCE)
+        {
+            snprintf(line, sizeof(line), "%s holds %.2f%% of the cells instead of %.2f%%", MATERIALS[m].name,
+                     100.0 * candidate.amounts[m], 100.0 * reference.amounts[m]);
+            problems.push_back(line);
+        }
+        // A material gone from every run has no height to compare
+        if (reference.layers[m] >= 0.0 && candidate.layers[m] >= 0.0 &&
+            std::abs(candidate.layers[m] - reference.layers[m]) > LAYER_TOLERANCE * height)
+        {
+            snprintf(line, sizeof(line), "%s sits at %.1f instead of %.1f", MATERIALS[m].name, candidate.layers[m],
+                     reference.layers[m]);
+            problems.push_back(line);
+        }
+    }
+
+    if (reference.slope >= 0.0 && candidate.slope >= 0.0 && std::abs(candidate.slope - reference.slope) > SLOPE_TOLERANCE)
+    {
+        snprintf(line, sizeof(line), "piles stand at %.1f degrees instead of %.1f", candidate.slope, reference.slope);
+        problems.push_back(line);
+    }
+    return problems;
+}
+
+int main(int argc, char **argv)
+{
+    CheckConfig config;
+    if (!parseArgs(argc, argv, config))
+        return 1;
+
+    // Every seed of every scenario for the reference and each candidate, one run per job
+    std::vector<const Engine *> engines = {&ENGINES[0]};
+    engines.insert(engines.end(), config.engines.begin(), config.engines.end());
+    const size_t seeds = config.seeds.size();
+    const size_t perScenario = engines.size() * seeds;
+    std::vector<RunResult> results(config.scenarios.size() * perScenario);
+
+    int jobs = config.jobs > 0 ? config.jobs : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    ThreadPool pool(std::min(jobs, static_cast<int>(results.size())));
+    pool.parallelFor(static_cast<int>(results.size()), [&](int run)
+                     {
+                         const Scenario &scenario = *config.scenarios[run / perScenario];
+                         const Engine &engine = *engines[run % perScenario / seeds];
+                         results[run] = runOne(config, scenario, engine, config.seeds[run % seeds]);
+                     });
+
+    int failed = 0;
+    for (size_t s = 0; s < config.scenarios.size(); s++)
+    {
+        auto runsOf = [&](size_t e)
+        {
+            auto first = results.begin() + s * perScenario + e * seeds;
+            return std::vector<RunResult>(first, first + seeds);
+        };
+        std::vector<RunResult> referenceRuns = runsOf(0);
+        Signature reference = average(referenceRuns);
+        bool settles = std::all_of(referenceRuns.begin(), referenceRuns.end(), [](const RunResult &r) { return r.settled; });
+        for (size_t e = 0; e < engines.size(); e++)
+        {
+            std::vector<RunResult> runs = runsOf(e);
+            std::vector<std::string> problems;
+            for (size_t i = 0; i < seeds; i++)
+            {
+                for (const std::string &failure : runs[i].failures)
+                    problems.push_back("seed " + std::to_string(config.seeds[i]) + ", " + failure);
+                if (runs[i].failureCount > MAX_REPORTED)
+                    problems.push_back("seed " + std::to_string(config.seeds[i]) + ", " +
+                                       std::to_string(runs[i].failureCount - MAX_REPORTED) + " more");
+            }
+            if (e > 0 && settles)
+            {
+                for (size_t i = 0; i < seeds; i++)
+                {
+                    if (!runs[i].settled)
+                        problems.push_back("seed " + std::to_string(config.seeds[i]) + " still moving after " +
+                                           std::to_string(config.steps) + " steps");
+                }
+                for (const std::string &problem : compare(reference, average(runs), config.height))
+                    problems.push_back(problem);
+            }
+
+            printf("%-4s %-15s %-13s %s%s\n", problems.empty() ? "ok" : "FAIL", config.scenarios[s]->name,
+                   engines[e]->name, e == 0 ? "(reference)" : engines[e]->description,
+                   e == 0 && !settles ? ", never settles so invariants only" : "");
+            for (const std::string &problem : problems)
+                printf("       %s\n", problem.c_str());
+            failed += !problems.empty();
+        }
+    }
+
+    printf("%d of %zu checks failed\n", failed, config.scenarios.size() * engines.size());
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "PixelWorld.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Command line parsing shared by the headless tools
+
+// Most seeds one run of a tool takes, far more worlds than it gets through
+inline constexpr uint64_t MAX_SEEDS = 1u << 20;
+
+// Items of a comma list, empty ones dropped
+inline std::vector<std::string> splitList(const char *arg)
+{
+    std::vector<std::string> items;
+    std::string current;
+    for (const char *c = arg;; c++)
+    {
+        if (*c == ',' || *c == '\0')
+        {
+            if (!current.empty())
+                items.push_back(current);
+            current.clear();
+            if (*c == '\0')
+                break;
+        }
+        else
+        {
+            current += *c;
+        }
+    }
+    return items;
+}
+
+// Replaces seeds with a comma list of numbers and inclusive a-b ranges, MAX_SEEDS in all at
+// most. Sorted with repeats dropped, so no seed runs twice.
+inline bool parseSeeds(const char *arg, std::vector<uint64_t> &seeds)
+{
+    seeds.clear();
+    for (const std::string &item : splitList(arg))
+    {
+        char *end;
+        uint64_t first = strtoull(item.c_str(), &end, 10), last = first;
+        if (end == item.c_str())
+            return false;
+        if (*end == '-')
+        {
+            const char *c = end + 1;
+            last = strtoull(c, &end, 10);
+            if (end == c || last < first)
+                return false;
+        }
+        // Counted rather than compared with last, which may be the largest seed there is
+        if (*end != '\0' || last - first >= MAX_SEEDS - seeds.size())
+            return false;
+        for (uint64_t n = 0; n <= last - first; n++)
+            seeds.push_back(first + n);
+    }
+    std::sort(seeds.begin(), seeds.end());
+    seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+    return !seeds.empty();
+}
+
+// The mode updateModeName() gives this name, false when there is none
+inline bool parseUpdateMode(const std::string &name, UpdateMode &mode)
+{
+    for (UpdateMode m : UPDATE_MODES)
+    {
+        if (name == updateModeName(m))
+        {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}